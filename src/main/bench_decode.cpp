@@ -0,0 +1,92 @@
+/*
+ * bench_decode.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ *
+ *  Microbenchmark of point decoders - compares scalar and SIMD
+ *  implementations on native and byte-swapped input
+ *
+ *  usage: bench_decode [points] [iterations]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "point_kernels.h"
+
+using point_kernels::DecodeImpl;
+
+static const char *implName(DecodeImpl impl) {
+	switch (impl) {
+	case DecodeImpl::scalar: return "scalar";
+	case DecodeImpl::ssse3: return "ssse3";
+	case DecodeImpl::avx2: return "avx2";
+	default: return "auto";
+	}
+}
+
+int main(int argc, char **argv) {
+	std::size_t points = argc > 1?std::strtoul(argv[1],nullptr,10):100000;
+	unsigned int iterations = argc > 2?std::strtoul(argv[2],nullptr,10):200;
+
+	std::mt19937 rnd(1);
+	std::uniform_real_distribution<float> dist(0.0f, 1872.0f);
+	std::vector<float> source(points*6);
+	for (float &f: source) f = dist(rnd);
+
+	std::string native(reinterpret_cast<const char *>(source.data()), source.size()*sizeof(float));
+	std::string swapped(native);
+	for (std::size_t i = 0; i < swapped.size(); i+=4) {
+		std::swap(swapped[i], swapped[i+3]);
+		std::swap(swapped[i+1], swapped[i+2]);
+	}
+
+	std::vector<float> columns(points*6), reference(points*6);
+	float * const cols[6] = {
+			columns.data(), columns.data()+points, columns.data()+2*points,
+			columns.data()+3*points, columns.data()+4*points, columns.data()+5*points
+	};
+	float * const refcols[6] = {
+			reference.data(), reference.data()+points, reference.data()+2*points,
+			reference.data()+3*points, reference.data()+4*points, reference.data()+5*points
+	};
+	point_kernels::decodePoints(native.data(), points, false, refcols, DecodeImpl::scalar);
+
+	std::cout << "points: " << points << ", iterations: " << iterations
+			  << ", best: " << implName(point_kernels::bestImpl()) << std::endl;
+
+	int ret = 0;
+	for (DecodeImpl impl: {DecodeImpl::scalar, DecodeImpl::ssse3, DecodeImpl::avx2}) {
+		if (!point_kernels::isSupported(impl)) {
+			std::cout << implName(impl) << ": not supported" << std::endl;
+			continue;
+		}
+		for (bool swap: {false, true}) {
+			const std::string &input = swap?swapped:native;
+			std::memset(columns.data(), 0, columns.size()*sizeof(float));
+			point_kernels::decodePoints(input.data(), points, swap, cols, impl);
+			bool ok = std::memcmp(columns.data(), reference.data(), columns.size()*sizeof(float)) == 0;
+			if (!ok) ret = 1;
+
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned int i = 0; i < iterations; i++) {
+				point_kernels::decodePoints(input.data(), points, swap, cols, impl);
+				asm volatile("" : : "r"(columns.data()) : "memory");
+			}
+			auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			double ns_per_point = static_cast<double>(dur.count())/(static_cast<double>(points)*iterations);
+			double mbps = static_cast<double>(input.size())*iterations/(dur.count()*0.001);
+			std::cout << implName(impl) << (swap?" swapped: ":" native:  ")
+					  << ns_per_point << " ns/point, " << mbps << " MB/s"
+					  << (ok?"":" MISMATCH") << std::endl;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,245 @@
+/*
+ * binformat.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "rmparser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const char bin_magic[4] = {'R','M','L','B'};
+
+std::uint16_t toHalf(float v) {
+	std::uint32_t f;
+	std::memcpy(&f, &v, sizeof(f));
+	std::uint32_t sign = (f >> 16) & 0x8000;
+	std::uint32_t exp = (f >> 23) & 0xFF;
+	std::uint32_t mant = f & 0x7FFFFF;
+	if (exp == 0xFF) return static_cast<std::uint16_t>(sign | 0x7C00 | (mant?0x200:0));
+	int e = static_cast<int>(exp) - 127 + 15;
+	if (e >= 31) return static_cast<std::uint16_t>(sign | 0x7C00);
+	std::uint32_t h, rem, halfway;
+	if (e <= 0) {
+		//subnormal number
+		if (e < -10) return static_cast<std::uint16_t>(sign);
+		mant |= 0x800000;
+		int shift = 14 - e;
+		h = mant >> shift;
+		rem = mant & ((1U << shift) - 1);
+		halfway = 1U << (shift - 1);
+	} else {
+		h = (static_cast<std::uint32_t>(e) << 10) | (mant >> 13);
+		rem = mant & 0x1FFF;
+		halfway = 0x1000;
+	}
+	//round to nearest even, carry can overflow to the exponent (and to infinity)
+	if (rem > halfway || (rem == halfway && (h & 1))) h++;
+	return static_cast<std::uint16_t>(sign | h);
+}
+
+float fromHalf(std::uint16_t h) {
+	int exp = (h >> 10) & 0x1F;
+	int mant = h & 0x3FF;
+	float v;
+	if (exp == 0) v = std::ldexp(static_cast<float>(mant), -24);
+	else if (exp == 31) v = mant?std::numeric_limits<float>::quiet_NaN():std::numeric_limits<float>::infinity();
+	else v = std::ldexp(static_cast<float>(mant | 0x400), exp - 25);
+	return (h & 0x8000)?-v:v;
+}
+
+void putFloat32(std::string &buffer, float v) {
+	std::uint32_t f;
+	std::memcpy(&f, &v, sizeof(f));
+	for (int i = 0; i < 4; i++) buffer.push_back(static_cast<char>((f >> (i * 8)) & 0xFF));
+}
+
+///Reads the binary format
+class BinReader {
+public:
+	BinReader(const std::string_view &data):pos(data.data()),end(data.data()+data.size()) {}
+
+	unsigned char readByte() {
+		if (pos == end) throw std::runtime_error("Binary data truncated");
+		return static_cast<unsigned char>(*pos++);
+	}
+	std::uint64_t readVarint() {
+		std::uint64_t v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			unsigned char b = readByte();
+			v |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+			if (!(b & 0x80)) return v;
+		}
+		throw std::runtime_error("Binary data - invalid varint");
+	}
+	std::int64_t readSigned() {
+		std::uint64_t v = readVarint();
+		return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+	}
+	float readFloat32() {
+		std::uint32_t f = 0;
+		for (int i = 0; i < 4; i++) f |= static_cast<std::uint32_t>(readByte()) << (i * 8);
+		float v;
+		std::memcpy(&v, &f, sizeof(v));
+		return v;
+	}
+	float readHalf() {
+		std::uint16_t h = readByte();
+		h |= static_cast<std::uint16_t>(readByte() << 8);
+		return fromHalf(h);
+	}
+	///Validates count of items, each item takes at least one byte
+	std::size_t readCount() {
+		std::uint64_t v = readVarint();
+		if (v > static_cast<std::uint64_t>(end - pos)) throw std::runtime_error("Binary data - invalid count");
+		return static_cast<std::size_t>(v);
+	}
+	bool eof() const {return pos == end;}
+
+protected:
+	const char *pos;
+	const char *end;
+};
+
+}
+
+Drawing::BinWriter::BinWriter(std::ostream &out, const BinOptions &opts)
+	:out(out)
+	,columns((opts.columns & Points::all_columns) | Points::bit(Points::col_x) | Points::bit(Points::col_y))
+	,half(opts.half)
+	,decimals(std::clamp(opts.decimals, 0, 6))
+	,mult(std::pow(10.0, decimals)) {}
+
+void Drawing::BinWriter::writeVarint(std::uint64_t v) {
+	while (v >= 0x80) {
+		buffer.push_back(static_cast<char>((v & 0x7F) | 0x80));
+		v >>= 7;
+	}
+	buffer.push_back(static_cast<char>(v));
+}
+
+void Drawing::BinWriter::begin_content(int version, std::size_t layers) {
+	buffer.clear();
+	buffer.append(bin_magic, sizeof(bin_magic));
+	buffer.push_back(static_cast<char>(format_version));
+	buffer.push_back(static_cast<char>(half?flag_half:0));
+	buffer.push_back(static_cast<char>(columns));
+	buffer.push_back(static_cast<char>(decimals));
+	buffer.push_back(static_cast<char>(version));
+	writeVarint(layers);
+	out.write(buffer.data(), buffer.size());
+}
+
+void Drawing::BinWriter::begin_layer(std::size_t, std::size_t lines) {
+	buffer.clear();
+	writeVarint(lines);
+	out.write(buffer.data(), buffer.size());
+}
+
+void Drawing::BinWriter::begin_line(const Line &ln) {
+	buffer.clear();
+	buffer.push_back(static_cast<char>(ln.type));
+	buffer.push_back(static_cast<char>(ln.color));
+	putFloat32(buffer, ln.size);
+}
+
+void Drawing::BinWriter::points(const Points &pts) {
+	//quantized values are limited, so differences can't overflow
+	static constexpr double max_quant = 1e15;
+	std::size_t cnt = pts.size();
+	writeVarint(cnt);
+	for (int c = 0; c < Points::column_count; c++) {
+		if (!(columns & Points::bit(static_cast<Points::Column>(c)))) continue;
+		const float *col = pts.column(static_cast<Points::Column>(c));
+		if (half) {
+			for (std::size_t i = 0; i < cnt; i++) {
+				std::uint16_t h = toHalf(std::isfinite(col[i])?col[i]:0.0f);
+				buffer.push_back(static_cast<char>(h & 0xFF));
+				buffer.push_back(static_cast<char>(h >> 8));
+			}
+		} else {
+			std::int64_t prev = 0;
+			for (std::size_t i = 0; i < cnt; i++) {
+				double v = std::isfinite(col[i])?std::clamp(col[i] * mult, -max_quant, max_quant):0.0;
+				std::int64_t q = std::llround(v);
+				std::int64_t d = q - prev;
+				prev = q;
+				writeVarint((static_cast<std::uint64_t>(d) << 1) ^ static_cast<std::uint64_t>(d >> 63));
+			}
+		}
+	}
+	out.write(buffer.data(), buffer.size());
+}
+
+void Drawing::write_bin(std::ostream &out, const BinOptions &opts) const {
+	BinWriter writer(out, opts);
+	content.visit(writer);
+}
+
+void Drawing::parse_bin(const std::string_view &data, Visitor &visitor) {
+	BinReader rd(data);
+	for (char c: bin_magic) {
+		if (static_cast<char>(rd.readByte()) != c) throw std::runtime_error("Binary data - invalid header");
+	}
+	if (rd.readByte() != BinWriter::format_version) throw std::runtime_error("Binary data - unsupported version");
+	bool half = (rd.readByte() & BinWriter::flag_half) != 0;
+	unsigned int columns = rd.readByte() & Points::all_columns;
+	unsigned int xy = Points::bit(Points::col_x) | Points::bit(Points::col_y);
+	if ((columns & xy) != xy) throw std::runtime_error("Binary data - invalid header");
+	int decimals = rd.readByte();
+	if (decimals > 6) throw std::runtime_error("Binary data - invalid header");
+	double step = std::pow(10.0, -decimals);
+	int version = rd.readByte();
+	std::size_t layersCount = rd.readCount();
+
+	visitor.begin_content(version, layersCount);
+	Line ln;
+	ln.reserved1 = 0;
+	ln.reserved2 = 0;
+	for (std::size_t i = 0; i < layersCount; i++) {
+		BinReader layer_start = rd;
+		do {
+			rd = layer_start;
+			std::size_t lines = rd.readCount();
+			visitor.begin_layer(i, lines);
+			for (std::size_t j = 0; j < lines; j++) {
+				unsigned char brush = rd.readByte();
+				unsigned char color = rd.readByte();
+				if (brush > static_cast<unsigned char>(Brush::SelectionBrush)) throw std::runtime_error("Binary data - unknown brush type");
+				if (color > static_cast<unsigned char>(Color::white)) throw std::runtime_error("Binary data - unknown colour");
+				ln.type = static_cast<Brush>(brush);
+				ln.color = static_cast<Color>(color);
+				ln.size = rd.readFloat32();
+				std::size_t cnt = rd.readCount();
+				ln.points.resize(cnt);
+				visitor.begin_line(ln);
+				for (int c = 0; c < Points::column_count; c++) {
+					float *col = ln.points.column(static_cast<Points::Column>(c));
+					if (!(columns & Points::bit(static_cast<Points::Column>(c)))) {
+						std::fill(col, col+cnt, 0.0f);
+					} else if (half) {
+						for (std::size_t k = 0; k < cnt; k++) col[k] = rd.readHalf();
+					} else {
+						std::int64_t q = 0;
+						for (std::size_t k = 0; k < cnt; k++) {
+							//wraps on invalid data instead of overflow
+							q = static_cast<std::int64_t>(static_cast<std::uint64_t>(q) + static_cast<std::uint64_t>(rd.readSigned()));
+							col[k] = static_cast<float>(static_cast<double>(q) * step);
+						}
+					}
+				}
+				visitor.points(ln.points);
+				visitor.end_line(ln);
+			}
+		} while (visitor.end_layer(i));
+	}
+	if (!rd.eof()) throw std::runtime_error("Binary data - unexpected data at the end");
+	visitor.end_content();
+}
@@ -0,0 +1,394 @@
+/*
+ * catalog.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "catalog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <imtjson/object.h>
+#include <pdf/mapped_file.h>
+#include <shared/logOutput.h>
+
+using ondra_shared::logError;
+using ondra_shared::logWarning;
+
+namespace {
+
+const char snapshot_magic[8] = {'R','M','C','A','T','L','O','G'};
+
+//current time (ns since epoch), time of changes reported by the watch
+std::int64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+Catalog::Catalog(const std::filesystem::path &root, FsWatch *watch, const std::filesystem::path &snapshot)
+	:root(root)
+	,instance(static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()))
+	,watch(watch)
+	,snapshot(snapshot) {
+	if (watch) {
+		//events which arrive during the scan are held and applied after the scan
+		subscriber = watch->subscribe([this](const FsWatch::Event &ev){onEvent(ev);}, false);
+		try {
+			root_wd = watch->add(subscriber, root.native(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+					| IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+			live = true;
+		} catch (const std::exception &e) {
+			logError("Catalog: can't watch the directory, it will be scanned on each request: $1", e.what());
+		}
+	} else {
+		logError("Catalog: watch is not available, the directory will be scanned on each request");
+	}
+	auto startWatch = [this]{
+		if (this->watch) this->watch->activate(subscriber);
+	};
+	if (loadSnapshot()) {
+		//requests are served from the snapshot until it is reconciled
+		loader = std::thread([this, startWatch]{
+			try {
+				reconcile();
+				saveSnapshot();
+			} catch (const std::exception &e) {
+				logError("Catalog: reconciliation failed: $1", e.what());
+			}
+			startWatch();
+		});
+	} else {
+		scan();
+		saveSnapshot();
+		startWatch();
+	}
+}
+
+Catalog::~Catalog() {
+	if (loader.joinable()) loader.join();
+	if (watch) watch->unsubscribe(subscriber);
+	try {
+		saveSnapshot();
+	} catch (const std::exception &e) {
+		logError("Catalog: can't save snapshot: $1", e.what());
+	}
+}
+
+bool Catalog::fileStamp(const std::filesystem::path &path, std::int64_t &size, std::int64_t &mtime) {
+	struct stat st;
+	if (::stat(path.c_str(), &st)) return false;
+	size = static_cast<std::int64_t>(st.st_size);
+	mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	return true;
+}
+
+void Catalog::readMetadata(const std::filesystem::path &path, Document &doc) {
+	doc.metadata = json::undefined;
+	doc.metadata_size = -1;
+	doc.metadata_mtime = 0;
+	//stamp is taken before reading, so a change during reading is detected later
+	if (!fileStamp(path, doc.metadata_size, doc.metadata_mtime)) return;
+	std::ifstream in(path, std::ios::in);
+	if (in) {
+		try {
+			doc.metadata = json::Value::fromStream(in);
+		} catch (std::exception &e) {
+			logError("Parse error: $1 - error: $2", path.native(), e.what());
+		}
+	}
+}
+
+void Catalog::scan() {
+	DocMap current;
+	{
+		std::shared_lock _(mx);
+		current = docs;
+	}
+	std::int64_t root_size, mtime = 0;
+	fileStamp(root, root_size, mtime);
+
+	DocMap newdocs;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator iter(root, ec), end; !ec && iter != end; iter.increment(ec)) {
+		const std::filesystem::path &fpath = iter->path();
+		auto stem = fpath.stem().string();
+		auto ext = fpath.extension().string();
+		Document &doc = newdocs[stem];
+		doc.objects.push_back(ext);
+		if (ext == ".metadata") {
+			//unchanged file is not read again
+			auto cur = current.find(stem);
+			std::int64_t md_size, md_mtime;
+			if (cur != current.end() && fileStamp(fpath, md_size, md_mtime)
+					&& cur->second.metadata_size == md_size && cur->second.metadata_mtime == md_mtime) {
+				doc.metadata = cur->second.metadata;
+				doc.metadata_size = md_size;
+				doc.metadata_mtime = md_mtime;
+			} else {
+				readMetadata(fpath, doc);
+			}
+		}
+	}
+	if (ec) logError("Catalog: can't read directory: $1 - error: $2", root.native(), ec.message());
+	//objects are sorted, so the result doesn't depend on order of the directory
+	for (auto &item: newdocs) {
+		std::sort(item.second.objects.begin(), item.second.objects.end());
+	}
+	std::unique_lock _(mx);
+	if (newdocs != docs) changed(newestMTime(newdocs, mtime));
+	docs.swap(newdocs);
+	root_mtime = mtime;
+}
+
+void Catalog::reconcile() {
+	std::int64_t size, mtime;
+	{
+		std::shared_lock _(mx);
+		if (!fileStamp(root, size, mtime) || mtime != root_mtime) mtime = -1;
+	}
+	if (mtime < 0) {
+		//entries of the directory has been changed
+		scan();
+		return;
+	}
+	//same entries, only content of the .metadata files can be changed
+	std::vector<std::pair<std::string, Document> > changed;
+	{
+		std::shared_lock _(mx);
+		for (const auto &item: docs) {
+			const Document &doc = item.second;
+			if (!std::binary_search(doc.objects.begin(), doc.objects.end(), std::string(".metadata"))) continue;
+			std::int64_t md_size, md_mtime;
+			if (!fileStamp(root / (item.first + ".metadata"), md_size, md_mtime)
+					|| md_size != doc.metadata_size || md_mtime != doc.metadata_mtime) {
+				changed.emplace_back(item.first, doc);
+			}
+		}
+	}
+	if (changed.empty()) return;
+	for (auto &item: changed) {
+		readMetadata(root / (item.first + ".metadata"), item.second);
+	}
+	std::int64_t newest = 0;
+	std::unique_lock _(mx);
+	for (auto &item: changed) {
+		Document &doc = docs[item.first];
+		doc.metadata = item.second.metadata;
+		doc.metadata_size = item.second.metadata_size;
+		doc.metadata_mtime = item.second.metadata_mtime;
+		newest = std::max(newest, doc.metadata_mtime);
+	}
+	this->changed(newest);
+}
+
+bool Catalog::loadSnapshot() {
+	if (snapshot.empty()) return false;
+	std::error_code ec;
+	if (!std::filesystem::exists(snapshot, ec)) return false;
+	try {
+		pdf::MappedFile mf(snapshot.native());
+		SnapshotHeader hdr;
+		if (mf.size() < sizeof(hdr)) throw std::runtime_error("File truncated");
+		std::memcpy(&hdr, mf.data(), sizeof(hdr));
+		if (std::memcmp(hdr.magic, snapshot_magic, sizeof(hdr.magic)) || hdr.version != snapshot_version) {
+			throw std::runtime_error("Unknown format");
+		}
+		std::size_t entries_size = static_cast<std::size_t>(hdr.count) * sizeof(SnapshotEntry);
+		std::size_t avail = mf.size() - sizeof(hdr);
+		if (entries_size > avail || avail - entries_size != hdr.strings_size) throw std::runtime_error("Invalid size");
+		const char *entries = mf.data() + sizeof(hdr);
+		std::string_view strings(entries + entries_size, hdr.strings_size);
+		auto getString = [&](std::uint32_t offset, std::uint32_t size) {
+			if (offset > strings.size() || size > strings.size() - offset) throw std::runtime_error("Invalid string");
+			return strings.substr(offset, size);
+		};
+
+		DocMap newdocs;
+		newdocs.reserve(hdr.count);
+		for (std::uint32_t i = 0; i < hdr.count; i++) {
+			SnapshotEntry e;
+			std::memcpy(&e, entries + i * sizeof(e), sizeof(e));
+			Document &doc = newdocs[std::string(getString(e.name_offset, e.name_size))];
+			std::string_view objects = getString(e.objects_offset, e.objects_size);
+			for (;;) {
+				auto sep = objects.find('/');
+				doc.objects.emplace_back(objects.substr(0, sep));
+				if (sep == objects.npos) break;
+				objects = objects.substr(sep+1);
+			}
+			if (e.metadata_size) {
+				std::string_view md = getString(e.metadata_offset, e.metadata_size);
+				doc.metadata = json::Value::fromString(json::StrViewA(md.data(), md.size()));
+			}
+			doc.metadata_size = e.file_size;
+			doc.metadata_mtime = e.file_mtime;
+		}
+		std::unique_lock _(mx);
+		docs.swap(newdocs);
+		root_mtime = hdr.root_mtime;
+		changed(newestMTime(docs, root_mtime));
+		return true;
+	} catch (const std::exception &e) {
+		logWarning("Catalog: can't load snapshot: $1 - error: $2", snapshot.native(), e.what());
+		return false;
+	}
+}
+
+void Catalog::saveSnapshot() {
+	if (snapshot.empty()) return;
+	std::string strings;
+	std::vector<SnapshotEntry> entries;
+	SnapshotHeader hdr;
+	std::memcpy(hdr.magic, snapshot_magic, sizeof(hdr.magic));
+	hdr.version = snapshot_version;
+	{
+		std::shared_lock _(mx);
+		hdr.root_mtime = root_mtime;
+		entries.reserve(docs.size());
+		auto addString = [&](std::string_view str, std::uint32_t &offset, std::uint32_t &size) {
+			offset = static_cast<std::uint32_t>(strings.size());
+			size = static_cast<std::uint32_t>(str.size());
+			strings.append(str);
+		};
+		for (const auto &item: docs) {
+			const Document &doc = item.second;
+			SnapshotEntry e = {};
+			addString(item.first, e.name_offset, e.name_size);
+			std::string objects;
+			for (std::size_t i = 0; i < doc.objects.size(); i++) {
+				if (i) objects.push_back('/');
+				objects.append(doc.objects[i]);
+			}
+			addString(objects, e.objects_offset, e.objects_size);
+			if (doc.metadata.defined()) {
+				std::string md;
+				doc.metadata.serialize([&](char c){md.push_back(c);});
+				addString(md, e.metadata_offset, e.metadata_size);
+			}
+			e.file_size = doc.metadata_size;
+			e.file_mtime = doc.metadata_mtime;
+			entries.push_back(e);
+		}
+	}
+	if (strings.size() > std::numeric_limits<std::uint32_t>::max()) throw std::runtime_error("Catalog is too large");
+	hdr.count = static_cast<std::uint32_t>(entries.size());
+	hdr.strings_size = strings.size();
+
+	//the snapshot is replaced atomically
+	auto tmp = snapshot;
+	tmp += ".tmp";
+	{
+		std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+		out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(SnapshotEntry));
+		out.write(strings.data(), strings.size());
+		if (!out) throw std::runtime_error("Can't write snapshot: " + tmp.native());
+	}
+	std::filesystem::rename(tmp, snapshot);
+}
+
+void Catalog::onEvent(const FsWatch::Event &ev) {
+	if (ev.mask & IN_Q_OVERFLOW) {
+		logWarning("Catalog: events have been lost, scanning the directory");
+		scan();
+	} else if (ev.wd != root_wd) {
+		//directories watched by the other subscribers
+		return;
+	} else if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+		logError("Catalog: directory has been removed: $1", root.native());
+		live = false;
+	} else if (!ev.name.empty()) {
+		//created file can be incomplete, metadata are read when the file is closed
+		if (ev.mask & IN_CREATE) updateEntry(ev.name, true, false);
+		else if (ev.mask & (IN_MOVED_TO | IN_CLOSE_WRITE)) updateEntry(ev.name, true, true);
+		else if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) updateEntry(ev.name, false, true);
+	}
+}
+
+void Catalog::updateEntry(std::string_view name, bool exists, bool metadata_changed) {
+	std::filesystem::path fpath = root / std::string(name);
+	auto stem = fpath.stem().string();
+	auto ext = fpath.extension().string();
+	bool is_metadata = ext == ".metadata";
+	Document md;
+	if (exists && is_metadata && metadata_changed) readMetadata(fpath, md);
+
+	std::unique_lock _(mx);
+	auto iter = docs.find(stem);
+	if (exists) {
+		if (iter == docs.end()) iter = docs.emplace(stem, Document()).first;
+		Document &doc = iter->second;
+		auto obj = std::lower_bound(doc.objects.begin(), doc.objects.end(), ext);
+		bool changed = false;
+		if (obj == doc.objects.end() || *obj != ext) {
+			doc.objects.insert(obj, ext);
+			changed = true;
+		}
+		if (is_metadata && metadata_changed) {
+			if (doc.metadata != md.metadata) {
+				doc.metadata = md.metadata;
+				changed = true;
+			}
+			doc.metadata_size = md.metadata_size;
+			doc.metadata_mtime = md.metadata_mtime;
+		}
+		if (changed) this->changed(now());
+	} else if (iter != docs.end()) {
+		Document &doc = iter->second;
+		auto obj = std::lower_bound(doc.objects.begin(), doc.objects.end(), ext);
+		if (obj != doc.objects.end() && *obj == ext) doc.objects.erase(obj);
+		if (is_metadata) {
+			doc.metadata = json::undefined;
+			doc.metadata_size = -1;
+		}
+		if (doc.objects.empty()) docs.erase(iter);
+		changed(now());
+	}
+}
+
+void Catalog::changed(std::int64_t mtime) {
+	++generation;
+	modified = std::max(modified, static_cast<std::time_t>(mtime / 1000000000));
+}
+
+std::int64_t Catalog::newestMTime(const DocMap &docs, std::int64_t root_mtime) {
+	std::int64_t newest = root_mtime;
+	for (const auto &item: docs) newest = std::max(newest, item.second.metadata_mtime);
+	return newest;
+}
+
+Catalog::Listing Catalog::getListing() {
+	if (!live) scan();
+	std::lock_guard _(listing_mx);
+	std::shared_lock lk(mx);
+	if (listing.generation != generation) {
+		json::Value v(json::object, docs.begin(), docs.end(), [&](const auto &item) ->json::Value {
+			if (item.second.metadata.defined()) {
+				return json::Value(item.first, json::Object
+							("metadata",item.second.metadata)
+							("objects",json::Value(json::array,
+									item.second.objects.begin(),
+									item.second.objects.end(),[&](const std::string &x) -> json::Value{
+					return x;
+				})));
+			} else {
+				return json::Value();
+			}
+		});
+		auto str = std::make_shared<std::string>();
+		v.serialize([&](char c){str->push_back(c);});
+		listing.generation = generation;
+		listing.last_modified = modified;
+		listing.json = std::move(str);
+	}
+	return listing;
+}
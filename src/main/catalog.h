@@ -0,0 +1,154 @@
+/*
+ * catalog.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_CATALOG_H_
+#define SRC_MAIN_CATALOG_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <imtjson/value.h>
+#include <shared/filesystem.h>
+#include "fs_watch.h"
+
+///Catalog of the documents in the root directory
+/**
+ * The catalog is built at start and it is kept current by watching the root
+ * directory. When the watch is not available, the directory is scanned on
+ * each request
+ */
+class Catalog {
+public:
+	struct Document {
+		///content of the .metadata file, undefined when not available
+		json::Value metadata;
+		///extensions of the entries of the document in the root directory
+		std::vector<std::string> objects;
+		///size of the .metadata file, when it was read, -1 - not read
+		std::int64_t metadata_size = -1;
+		///time of modification of the .metadata file (ns), when it was read
+		std::int64_t metadata_mtime = 0;
+
+		bool operator==(const Document &other) const {
+			return metadata == other.metadata && objects == other.objects;
+		}
+	};
+
+	///Serialized list of the documents (JSON)
+	struct Listing {
+		///generation of the catalog
+		std::uint64_t generation = 0;
+		///time of the last change of the catalog (seconds since epoch)
+		std::time_t last_modified = 0;
+		std::shared_ptr<const std::string> json;
+	};
+
+	///Construct catalog
+	/**
+	 * @param root root directory
+	 * @param watch shared watch, nullptr - not available. The watch is started by the caller
+	 * @param snapshot path to the snapshot file, empty - snapshot is not used. When
+	 * the snapshot exists, the catalog is loaded from the snapshot and reconciled
+	 * with the directory in background. The snapshot is written after the
+	 * reconciliation and when the catalog is destroyed
+	 */
+	Catalog(const std::filesystem::path &root, FsWatch *watch, const std::filesystem::path &snapshot = std::filesystem::path());
+	~Catalog();
+
+	Catalog(const Catalog &) = delete;
+	Catalog &operator=(const Catalog &) = delete;
+
+	///Returns list of the documents, serialization is cached until the catalog is changed
+	Listing getListing();
+	///Returns identifier of the instance, generations of different instances are not comparable
+	std::uint64_t getInstance() const {return instance;}
+	///Returns true, when the catalog is updated by the watch
+	bool isLive() const {return live;}
+
+protected:
+	using DocMap = std::unordered_map<std::string, Document>;
+
+	std::filesystem::path root;
+	std::uint64_t instance;
+	mutable std::shared_mutex mx;
+	DocMap docs;
+	//incremented with each change
+	std::uint64_t generation = 1;
+	//time of the last change (seconds since epoch). Scan uses the newest mtime of the
+	//directory and the .metadata files, changes reported by the watch use current time
+	std::time_t modified = 0;
+
+	std::mutex listing_mx;
+	Listing listing;
+
+	std::atomic<bool> live = false;
+	FsWatch *watch;
+	FsWatch::Subscriber subscriber = 0;
+	int root_wd = -1;
+
+	std::filesystem::path snapshot;
+	//time of modification of the root directory (ns) before the last scan, the list
+	//of the entries is not older than this time
+	std::int64_t root_mtime = 0;
+	//reconciles the catalog loaded from the snapshot
+	std::thread loader;
+
+	///Fixed layout of the snapshot file, followed by the entries and the string table
+	struct SnapshotHeader {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t count;
+		std::int64_t root_mtime;
+		std::uint64_t strings_size;
+	};
+	struct SnapshotEntry {
+		//offsets and sizes in the string table
+		std::uint32_t name_offset, name_size;
+		//extensions separated by '/'
+		std::uint32_t objects_offset, objects_size;
+		//serialized JSON, size 0 - undefined
+		std::uint32_t metadata_offset, metadata_size;
+		std::int64_t file_size;
+		std::int64_t file_mtime;
+	};
+	static constexpr std::uint32_t snapshot_version = 1;
+
+	///Scans whole directory, replaces content of the catalog
+	/**
+	 * .metadata file is read only when its size or time of modification differs
+	 * from the current content
+	 */
+	void scan();
+	///Brings the catalog loaded from the snapshot up to date
+	void reconcile();
+	bool loadSnapshot();
+	void saveSnapshot();
+	void onEvent(const FsWatch::Event &ev);
+	///Marks the catalog changed (must be called under lock)
+	/**
+	 * @param mtime time of the change (ns since epoch)
+	 */
+	void changed(std::int64_t mtime);
+	///Returns newest time of modification of the directory and the .metadata files (ns)
+	static std::int64_t newestMTime(const DocMap &docs, std::int64_t root_mtime);
+	///Updates the document after the entry has been created or deleted
+	void updateEntry(std::string_view name, bool exists, bool metadata_changed);
+	///Reads .metadata file, updates metadata and the stamp of the document
+	static void readMetadata(const std::filesystem::path &path, Document &doc);
+	///Retrieves size and time of modification (ns) of the file
+	static bool fileStamp(const std::filesystem::path &path, std::int64_t &size, std::int64_t &mtime);
+};
+
+#endif /* SRC_MAIN_CATALOG_H_ */
@@ -0,0 +1,171 @@
+/*
+ * fs_watch.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "fs_watch.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <system_error>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <shared/logOutput.h>
+
+using ondra_shared::logError;
+
+FsWatch::FsWatch() {
+	fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (fd < 0) throw std::system_error(errno, std::generic_category(), "inotify_init1");
+	if (pipe2(wake, O_CLOEXEC)) {
+		int e = errno;
+		::close(fd);
+		throw std::system_error(e, std::generic_category(), "pipe2");
+	}
+}
+
+FsWatch::~FsWatch() {
+	stop();
+	::close(wake[0]);
+	::close(wake[1]);
+	::close(fd);
+}
+
+FsWatch::Subscriber FsWatch::subscribe(Callback cb, bool active) {
+	std::lock_guard _(mx);
+	Subscriber sub = next_subscriber++;
+	subscribers.emplace(sub, Subscription{std::move(cb), active, {}});
+	return sub;
+}
+
+void FsWatch::activate(Subscriber sub) {
+	//the thread doesn't dispatch, so no event can be held meanwhile
+	std::lock_guard _(dispatch_mx);
+	std::deque<HeldEvent> held;
+	const Callback *cb;
+	{
+		std::lock_guard _(mx);
+		auto iter = subscribers.find(sub);
+		if (iter == subscribers.end()) return;
+		held.swap(iter->second.held);
+		iter->second.active = true;
+		cb = &iter->second.cb;
+	}
+	for (const HeldEvent &h: held) call(*cb, Event{h.wd, h.mask, h.name});
+}
+
+void FsWatch::unsubscribe(Subscriber sub) {
+	//waits for the running callback
+	std::lock_guard _(dispatch_mx);
+	std::lock_guard __(mx);
+	for (auto iter = owners.begin(); iter != owners.end();) {
+		iter->second.erase(sub);
+		if (iter->second.empty()) {
+			inotify_rm_watch(fd, iter->first);
+			iter = owners.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	subscribers.erase(sub);
+}
+
+int FsWatch::add(Subscriber sub, const std::string &path, unsigned int mask) {
+	std::lock_guard _(mx);
+	//the mask of the other subscribers is kept
+	int wd = inotify_add_watch(fd, path.c_str(), mask | IN_MASK_ADD);
+	if (wd < 0) throw std::system_error(errno, std::generic_category(), "inotify_add_watch: " + path);
+	owners[wd].insert(sub);
+	return wd;
+}
+
+void FsWatch::remove(Subscriber sub, int wd) {
+	std::lock_guard _(mx);
+	auto iter = owners.find(wd);
+	if (iter == owners.end()) return;
+	iter->second.erase(sub);
+	if (iter->second.empty()) {
+		inotify_rm_watch(fd, wd);
+		owners.erase(iter);
+	}
+}
+
+std::size_t FsWatch::getWatchCount() const {
+	std::lock_guard _(mx);
+	return owners.size();
+}
+
+void FsWatch::start() {
+	stop();
+	thr = std::thread([this]{worker();});
+}
+
+void FsWatch::stop() {
+	if (thr.joinable()) {
+		char c = 0;
+		while (::write(wake[1], &c, 1) < 0 && errno == EINTR);
+		thr.join();
+		//clear the pipe, so the watch can be started again
+		while (::read(wake[0], &c, 1) < 0 && errno == EINTR);
+	}
+}
+
+void FsWatch::call(const Callback &cb, const Event &ev) {
+	try {
+		cb(ev);
+	} catch (const std::exception &ex) {
+		logError("FsWatch: exception in callback: $1", ex.what());
+	}
+}
+
+void FsWatch::dispatch(const Event &ev) {
+	std::lock_guard _(dispatch_mx);
+	std::vector<const Callback *> active;
+	{
+		std::lock_guard _(mx);
+		for (auto &item: subscribers) {
+			Subscription &s = item.second;
+			if (s.active) {
+				active.push_back(&s.cb);
+			} else if (s.held.size() < max_held_events || (ev.mask & IN_IGNORED)) {
+				s.held.push_back(HeldEvent{ev.wd, ev.mask, std::string(ev.name)});
+			} else if (!(s.held.back().mask & IN_Q_OVERFLOW)) {
+				//the subscriber reloads everything, removal of the watches must not be lost
+				s.held.push_back(HeldEvent{-1, IN_Q_OVERFLOW, std::string()});
+			}
+		}
+		//watch has been removed by the kernel (the directory has been deleted)
+		if (ev.mask & IN_IGNORED) owners.erase(ev.wd);
+	}
+	//subscribers are removed under dispatch_mx, so the callbacks stay valid
+	for (const Callback *cb: active) call(*cb, ev);
+}
+
+void FsWatch::worker() {
+	alignas(struct inotify_event) char buffer[16384];
+	pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+	for (;;) {
+		int r = ::poll(fds, 2, -1);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			logError("FsWatch: poll failed: $1", std::strerror(errno));
+			return;
+		}
+		if (fds[1].revents) return;
+		if (!(fds[0].revents & POLLIN)) continue;
+		for (;;) {
+			ssize_t len = ::read(fd, buffer, sizeof(buffer));
+			if (len <= 0) break;
+			for (char *p = buffer; p < buffer + len;) {
+				auto *ev = reinterpret_cast<const struct inotify_event *>(p);
+				dispatch(Event{ev->wd, ev->mask, ev->len?std::string_view(ev->name):std::string_view()});
+				p += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+	}
+}
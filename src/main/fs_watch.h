@@ -0,0 +1,121 @@
+/*
+ * fs_watch.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_FS_WATCH_H_
+#define SRC_MAIN_FS_WATCH_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+///Watches directories for changes (inotify)
+/**
+ * One object (one inotify instance and one thread) is shared by more
+ * subscribers. Events are delivered by the own thread of the object, one at
+ * time, each event to all subscribers. The subscriber ignores events of the
+ * watch descriptors, which it didn't add.
+ *
+ * Watches of the same directory added by more subscribers have the same
+ * descriptor and their masks are combined. The directory is watched until
+ * all subscribers remove the watch.
+ */
+class FsWatch {
+public:
+	struct Event {
+		///watch descriptor (see add), -1 for overflow
+		int wd;
+		///inotify mask of the event (IN_CREATE, IN_DELETE, ...)
+		unsigned int mask;
+		///name of the entry in the directory, can be empty
+		std::string_view name;
+	};
+
+	using Callback = std::function<void(const Event &)>;
+	///Identifier of the subscriber
+	using Subscriber = unsigned int;
+
+	///count of events held for the inactive subscriber, further events are replaced by overflow
+	static constexpr std::size_t max_held_events = 4096;
+
+	FsWatch();
+	~FsWatch();
+
+	FsWatch(const FsWatch &) = delete;
+	FsWatch &operator=(const FsWatch &) = delete;
+
+	///Registers subscriber
+	/**
+	 * @param cb function, which receives events
+	 * @param active true - events are delivered immediately, false - events are held
+	 * until the subscriber is activated (for example until it loads its state)
+	 * @return identifier of the subscriber
+	 */
+	Subscriber subscribe(Callback cb, bool active = true);
+	///Delivers held events to the subscriber and activates it
+	void activate(Subscriber sub);
+	///Removes subscriber and its watches
+	/**
+	 * When function returns, the callback is not running and it is not called
+	 * again. Must not be called from the callback
+	 */
+	void unsubscribe(Subscriber sub);
+	///Adds path to the watches of the subscriber
+	/**
+	 * @param sub subscriber
+	 * @param path path
+	 * @param mask inotify mask, it is combined with the masks of other subscribers
+	 * @return watch descriptor. Throws exception on error
+	 */
+	int add(Subscriber sub, const std::string &path, unsigned int mask);
+	///Removes watch of the subscriber
+	void remove(Subscriber sub, int wd);
+	///Returns count of watched directories
+	std::size_t getWatchCount() const;
+	///Starts the thread, which delivers events
+	/**
+	 * Event with IN_Q_OVERFLOW means that some events were lost
+	 */
+	void start();
+	///Stops the thread
+	void stop();
+
+protected:
+	struct HeldEvent {
+		int wd;
+		unsigned int mask;
+		std::string name;
+	};
+	struct Subscription {
+		Callback cb;
+		bool active;
+		std::deque<HeldEvent> held;
+	};
+
+	int fd;
+	//pipe to wake up the thread
+	int wake[2];
+	std::thread thr;
+	//protects subscribers and owners
+	mutable std::mutex mx;
+	//held while the callbacks are called
+	std::mutex dispatch_mx;
+	std::unordered_map<Subscriber, Subscription> subscribers;
+	//subscribers of the watch descriptors
+	std::unordered_map<int, std::unordered_set<Subscriber> > owners;
+	Subscriber next_subscriber = 1;
+
+	void worker();
+	void dispatch(const Event &ev);
+	static void call(const Callback &cb, const Event &ev);
+};
+
+#endif /* SRC_MAIN_FS_WATCH_H_ */
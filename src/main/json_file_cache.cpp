@@ -0,0 +1,83 @@
+/*
+ * json_file_cache.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "json_file_cache.h"
+
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sys/stat.h>
+#include <imtjson/object.h>
+#include <shared/logOutput.h>
+
+using ondra_shared::logError;
+
+JSONFileCache::Shard &JSONFileCache::getShard(const std::string &key) {
+	return shards[std::hash<std::string>()(key) % shard_count];
+}
+
+JSONFileCache::PFile JSONFileCache::get(const std::filesystem::path &path) {
+	const std::string &key = path.native();
+	Shard &sh = getShard(key);
+	struct stat st;
+	if (::stat(key.c_str(), &st)) {
+		std::unique_lock _(sh.mx);
+		sh.map.erase(key);
+		return nullptr;
+	}
+	std::int64_t size = static_cast<std::int64_t>(st.st_size);
+	std::int64_t mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	{
+		std::shared_lock _(sh.mx);
+		auto iter = sh.map.find(key);
+		if (iter != sh.map.end() && iter->second->size == size && iter->second->mtime == mtime) {
+			hits.fetch_add(1, std::memory_order_relaxed);
+			return iter->second;
+		}
+	}
+	//the file is parsed without lock, concurrent loads of the same file are harmless
+	loads.fetch_add(1, std::memory_order_relaxed);
+	PFile f = load(path, size, mtime);
+	std::unique_lock _(sh.mx);
+	if (f) sh.map[key] = f;
+	else sh.map.erase(key);
+	return f;
+}
+
+JSONFileCache::PFile JSONFileCache::load(const std::filesystem::path &path, std::int64_t size, std::int64_t mtime) {
+	std::ifstream in(path, std::ios::in);
+	if (!in) {
+		logError("Can't open file: $1", path.native());
+		return nullptr;
+	}
+	auto f = std::make_shared<File>();
+	try {
+		f->value = json::Value::fromStream(in);
+	} catch (const std::exception &e) {
+		logError("Parse error: $1 - error: $2", path.native(), e.what());
+		return nullptr;
+	}
+	//the file was stat before it was read, so a change during reading is detected by next access
+	f->size = size;
+	f->mtime = mtime;
+	json::Value pages = f->value["pages"];
+	f->pages.reserve(pages.size());
+	for (json::Value v: pages) f->pages.push_back(v.getString());
+	return f;
+}
+
+json::Value JSONFileCache::getStats() const {
+	std::size_t entries = 0;
+	for (const Shard &sh: shards) {
+		std::shared_lock _(sh.mx);
+		entries += sh.map.size();
+	}
+	return json::Object
+			("entries", entries)
+			("hits", hits.load(std::memory_order_relaxed))
+			("loads", loads.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,74 @@
+/*
+ * json_file_cache.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_JSON_FILE_CACHE_H_
+#define SRC_MAIN_JSON_FILE_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <imtjson/value.h>
+#include <shared/filesystem.h>
+
+///Cache of parsed JSON files (.content, .metadata)
+/**
+ * Entry is validated by size and time of modification of the file on each
+ * access, so only stat is needed, when the file has not been changed. The cache
+ * is divided to shards, readers of the same shard share the lock
+ */
+class JSONFileCache {
+public:
+	struct File {
+		json::Value value;
+		///identifiers of the pages (.content), index is number of the page
+		std::vector<std::string> pages;
+		///size and time of modification (ns) of the file, when it was read
+		std::int64_t size = 0;
+		std::int64_t mtime = 0;
+
+		///Returns identifier of the page, empty when page doesn't exist
+		std::string_view getPage(unsigned long page) const {
+			return page < pages.size()?std::string_view(pages[page]):std::string_view();
+		}
+	};
+
+	using PFile = std::shared_ptr<const File>;
+
+	///Count of shards
+	static constexpr std::size_t shard_count = 16;
+
+	///Returns parsed file
+	/**
+	 * @param path path to the file
+	 * @return parsed file, nullptr when file doesn't exist or can't be parsed
+	 */
+	PFile get(const std::filesystem::path &path);
+
+	json::Value getStats() const;
+
+protected:
+	struct Shard {
+		mutable std::shared_mutex mx;
+		std::unordered_map<std::string, PFile> map;
+	};
+
+	Shard shards[shard_count];
+
+	std::atomic<std::uint64_t> hits{0};
+	std::atomic<std::uint64_t> loads{0};
+
+	Shard &getShard(const std::string &key);
+	static PFile load(const std::filesystem::path &path, std::int64_t size, std::int64_t mtime);
+};
+
+#endif /* SRC_MAIN_JSON_FILE_CACHE_H_ */
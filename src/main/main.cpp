@@ -79,7 +79,28 @@ int main(int argc, char **argv) {
 			static_cast<unsigned int>(section_www["cache_interval"].getUInt(0))
 	};
 
-	auto rmfs = std::make_shared<RmRpcFSys>(section_filesystem.mandatory["path"].getPath());
+	auto rmfs = std::make_shared<RmRpcFSys>(section_filesystem.mandatory["path"].getPath(),
+			static_cast<unsigned int>(section_server["render_threads"].getUInt(0)),
+			static_cast<std::size_t>(section_server["lines_cache_size"].getUInt(0)),
+			section_filesystem["catalog_snapshot"].defined()?section_filesystem["catalog_snapshot"].getPath():std::string());
+
+	RmRpcFSys::CacheControl cache_control;
+	auto section_cache_control = app.config["cache_control"];
+	for (auto [name, value]: {
+			std::pair("lines", &cache_control.lines),
+			std::pair("info", &cache_control.info),
+			std::pair("list", &cache_control.list),
+			std::pair("thumb", &cache_control.thumb)}) {
+		auto v = section_cache_control[name];
+		if (v.defined()) *value = v.getString();
+	}
+	rmfs->setCacheControl(cache_control);
+
+	auto section_compression = app.config["compression"];
+	CompressionConfig compression;
+	compression.level = static_cast<int>(section_compression["level"].getUInt(compression.level));
+	compression.min_size = static_cast<std::size_t>(section_compression["min_size"].getUInt(compression.min_size));
+	rmfs->setCompression(compression);
 
 	MyHttpServer server;
 
@@ -87,7 +108,7 @@ int main(int argc, char **argv) {
 	server.addPath("", userver::StaticWebserver(static_web_cfg));
 	server.add_listMethods();
 	server.add_ping();
-	server.addStats("/stats", nullptr);
+	server.addStats("/stats", [rmfs]{return rmfs->getStats();});
 
 	rmfs->initRpc(rmfs, server);
 	rmfs->initHttp(rmfs, server);
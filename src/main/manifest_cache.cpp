@@ -0,0 +1,211 @@
+/*
+ * manifest_cache.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "manifest_cache.h"
+
+#include <cerrno>
+#include <mutex>
+#include <system_error>
+#include <sys/inotify.h>
+#include <imtjson/object.h>
+#include <shared/logOutput.h>
+
+using ondra_shared::logDebug;
+using ondra_shared::logError;
+using ondra_shared::logWarning;
+
+namespace {
+
+//changes of the entries, attributes are included because the fingerprint contains mtime
+constexpr unsigned int watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+		| IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+//directories of the document, relative to the root (index of the watch descriptor in Entry)
+const char *document_dirs[] = {"", ".thumbnails", ".textconversion"};
+
+}
+
+ManifestCache::ManifestCache(const std::filesystem::path &root, FsWatch *watch, std::size_t max_documents)
+	:root(root)
+	,max_documents(max_documents)
+	,watch(watch) {
+	if (!watch) {
+		logError("ManifestCache: watch is not available, manifests will not be cached");
+		return;
+	}
+	subscriber = watch->subscribe([this](const FsWatch::Event &ev){onEvent(ev);});
+	try {
+		root_wd = watch->add(subscriber, root.native(), watch_mask);
+		live = true;
+	} catch (const std::exception &e) {
+		logError("ManifestCache: can't watch the directory, manifests will not be cached: $1", e.what());
+	}
+}
+
+ManifestCache::~ManifestCache() {
+	if (watch) watch->unsubscribe(subscriber);
+}
+
+ManifestCache::PManifest ManifestCache::get(const std::string &id, const Builder &builder) {
+	if (!live) {
+		builds.fetch_add(1, std::memory_order_relaxed);
+		return builder(id);
+	}
+	if (PManifest m = find(id)) return m;
+	std::uint64_t version;
+	{
+		//watches are added before the files are read, so no change can be missed
+		std::unique_lock _(mx);
+		auto ins = entries.try_emplace(id);
+		Entry &entry = ins.first->second;
+		if (ins.second) entry.version = ++next_version;
+		entry.last_use.store(++use_counter, std::memory_order_relaxed);
+		if (!watchDocument(id, entry)) {
+			//changes would not be reported, so the manifest is not cached
+			if (!entry.manifest) {
+				unwatchDocument(entry);
+				entries.erase(ins.first);
+			}
+			_.unlock();
+			builds.fetch_add(1, std::memory_order_relaxed);
+			return builder(id);
+		}
+		version = entry.version;
+		if (ins.second) evict(id);
+	}
+	builds.fetch_add(1, std::memory_order_relaxed);
+	PManifest m = builder(id);
+	std::unique_lock _(mx);
+	auto iter = entries.find(id);
+	if (iter != entries.end() && iter->second.version == version) {
+		if (m) {
+			iter->second.manifest = m;
+		} else if (!iter->second.manifest) {
+			//don't keep entries of unknown documents
+			unwatchDocument(iter->second);
+			entries.erase(iter);
+		}
+	}
+	return m;
+}
+
+ManifestCache::PManifest ManifestCache::find(const std::string &id) {
+	if (!live) return nullptr;
+	std::shared_lock _(mx);
+	auto iter = entries.find(id);
+	if (iter == entries.end() || !iter->second.manifest) return nullptr;
+	iter->second.last_use.store(++use_counter, std::memory_order_relaxed);
+	hits.fetch_add(1, std::memory_order_relaxed);
+	return iter->second.manifest;
+}
+
+bool ManifestCache::watchDocument(const std::string &id, Entry &entry) {
+	for (int i = 0; i < dir_count; i++) {
+		if (entry.wds[i] >= 0) continue;
+		auto path = root / (id + document_dirs[i]);
+		try {
+			entry.wds[i] = watch->add(subscriber, path.native(), watch_mask);
+			watched[entry.wds[i]] = id;
+		} catch (const std::system_error &e) {
+			if (e.code().value() != ENOENT) {
+				logWarning("ManifestCache: can't watch $1, manifest will not be cached: $2", path.native(), e.what());
+				return false;
+			}
+			//directory doesn't exist, its creation is reported by the watch of the root
+			logDebug("ManifestCache: can't watch $1: $2", path.native(), e.what());
+		}
+	}
+	return true;
+}
+
+void ManifestCache::unwatchDocument(Entry &entry) {
+	for (int &wd: entry.wds) {
+		if (wd < 0) continue;
+		watched.erase(wd);
+		watch->remove(subscriber, wd);
+		wd = -1;
+	}
+}
+
+void ManifestCache::evict(const std::string &keep) {
+	while (entries.size() > max_documents) {
+		auto victim = entries.end();
+		std::uint64_t oldest = ~std::uint64_t(0);
+		for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+			std::uint64_t use = iter->second.last_use.load(std::memory_order_relaxed);
+			if (use < oldest && iter->first != keep) {
+				oldest = use;
+				victim = iter;
+			}
+		}
+		if (victim == entries.end()) return;
+		unwatchDocument(victim->second);
+		entries.erase(victim);
+		evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void ManifestCache::invalidate(const std::string &id) {
+	auto iter = entries.find(id);
+	if (iter == entries.end()) return;
+	iter->second.version = ++next_version;
+	if (iter->second.manifest) {
+		iter->second.manifest = nullptr;
+		invalidations.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void ManifestCache::invalidateAll() {
+	for (auto &item: entries) invalidate(item.first);
+}
+
+void ManifestCache::onEvent(const FsWatch::Event &ev) {
+	std::unique_lock _(mx);
+	if (ev.mask & IN_Q_OVERFLOW) {
+		logWarning("ManifestCache: events have been lost, all manifests are invalidated");
+		invalidateAll();
+	} else if (ev.wd == root_wd) {
+		if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+			logError("ManifestCache: directory has been removed: $1", root.native());
+			live = false;
+			invalidateAll();
+		} else if (!ev.name.empty()) {
+			//name of the entry is the id followed by the extension
+			invalidate(std::string(ev.name.substr(0, ev.name.find('.'))));
+		}
+	} else {
+		auto iter = watched.find(ev.wd);
+		if (iter == watched.end()) return;
+		invalidate(iter->second);
+		//watch has been removed (the directory has been deleted)
+		if (ev.mask & IN_IGNORED) {
+			auto eiter = entries.find(iter->second);
+			if (eiter != entries.end()) {
+				for (int &wd: eiter->second.wds) if (wd == ev.wd) wd = -1;
+			}
+			watched.erase(iter);
+		}
+	}
+}
+
+json::Value ManifestCache::getStats() const {
+	std::size_t count = 0;
+	std::size_t dirs = 0;
+	{
+		std::shared_lock _(mx);
+		for (const auto &item: entries) if (item.second.manifest) ++count;
+		dirs = watched.size();
+	}
+	return json::Object
+			("live", isLive())
+			("entries", count)
+			("watched_dirs", dirs)
+			("hits", hits.load(std::memory_order_relaxed))
+			("builds", builds.load(std::memory_order_relaxed))
+			("invalidations", invalidations.load(std::memory_order_relaxed))
+			("evictions", evictions.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,132 @@
+/*
+ * manifest_cache.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_MANIFEST_CACHE_H_
+#define SRC_MAIN_MANIFEST_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include <imtjson/value.h>
+#include <shared/filesystem.h>
+#include "fs_watch.h"
+
+///Cache of the manifests of the documents (content of the /info response)
+/**
+ * The manifest is built on the first request and it is kept until a file of
+ * the document is changed. The root directory and the directories of the
+ * document (pages, thumbnails, text conversions) are watched. When the watch
+ * is not available, the manifest is built on each request.
+ *
+ * Count of the documents is limited, the least recently used document is
+ * evicted with its watches
+ */
+class ManifestCache {
+public:
+	struct Manifest {
+		///content of the /info response
+		json::Value info;
+		///fingerprint of the source files (see RmRpcFSys::Fingerprint)
+		std::string fingerprint;
+		///time of the newest source file (seconds since epoch)
+		std::time_t last_modified = 0;
+	};
+
+	using PManifest = std::shared_ptr<const Manifest>;
+	///Builds manifest of the document, returns nullptr when document doesn't exist
+	using Builder = std::function<PManifest(const std::string &id)>;
+
+	///Construct cache
+	/**
+	 * @param root root directory
+	 * @param watch shared watch, nullptr - not available, manifests are not cached
+	 * @param max_documents max count of the cached documents
+	 */
+	ManifestCache(const std::filesystem::path &root, FsWatch *watch, std::size_t max_documents = default_max_documents);
+	~ManifestCache();
+
+	ManifestCache(const ManifestCache &) = delete;
+	ManifestCache &operator=(const ManifestCache &) = delete;
+
+	///Returns manifest of the document
+	/**
+	 * @param id identifier of the document
+	 * @param builder function which builds the manifest when it is not cached
+	 * @return manifest, or nullptr when document doesn't exist
+	 */
+	PManifest get(const std::string &id, const Builder &builder);
+	///Returns cached manifest of the document, nullptr when it is not cached
+	PManifest find(const std::string &id);
+
+	///Returns true, when the manifests are invalidated by the watch
+	bool isLive() const {return live;}
+
+	json::Value getStats() const;
+
+	static constexpr std::size_t default_max_documents = 1024;
+
+protected:
+	static constexpr int dir_count = 3;
+
+	struct Entry {
+		PManifest manifest;
+		///changed by each invalidation, manifest built meanwhile is not stored
+		std::uint64_t version = 0;
+		///watch descriptors of the directories of the document, -1 - not watched
+		int wds[dir_count] = {-1, -1, -1};
+		///last use (value of use_counter)
+		std::atomic<std::uint64_t> last_use{0};
+	};
+
+	std::filesystem::path root;
+	mutable std::shared_mutex mx;
+	std::unordered_map<std::string, Entry> entries;
+	//watched directories of the documents (watch descriptor -> id)
+	std::unordered_map<int, std::string> watched;
+	int root_wd = -1;
+	std::size_t max_documents;
+	//source of the versions, the version is not reused when the entry is evicted and created again
+	std::uint64_t next_version = 0;
+	std::atomic<std::uint64_t> use_counter{0};
+
+	std::atomic<bool> live = false;
+	FsWatch *watch;
+	FsWatch::Subscriber subscriber = 0;
+
+	std::atomic<std::uint64_t> hits{0};
+	std::atomic<std::uint64_t> builds{0};
+	std::atomic<std::uint64_t> invalidations{0};
+	std::atomic<std::uint64_t> evictions{0};
+
+	void onEvent(const FsWatch::Event &ev);
+	///Invalidates manifest of the document (must be called under lock)
+	void invalidate(const std::string &id);
+	///Invalidates all manifests (must be called under lock)
+	void invalidateAll();
+	///Watches directories of the document, which are not watched yet (must be called under lock)
+	/**
+	 * @retval true all existing directories are watched
+	 * @retval false watch can't be added (for example limit of watches has been reached),
+	 * manifest must not be cached
+	 */
+	bool watchDocument(const std::string &id, Entry &entry);
+	///Removes least recently used documents and their watches above the limit (must be called under lock)
+	/**
+	 * @param keep document, which is not removed
+	 */
+	void evict(const std::string &keep);
+	///Removes watches of the document (must be called under lock)
+	void unwatchDocument(Entry &entry);
+};
+
+#endif /* SRC_MAIN_MANIFEST_CACHE_H_ */
@@ -0,0 +1,79 @@
+/*
+ * numformat.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "numformat.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+NumFormat::NumFormat(int decimals)
+	:decimals(decimals == shortest?shortest:std::clamp(decimals, 0, max_decimals))
+	,scale(1) {
+	for (int i = 0; i < this->decimals; i++) scale *= 10;
+}
+
+static char *writeUInt(unsigned long long v, char *buffer) {
+	char tmp[24];
+	char *p = tmp + sizeof(tmp);
+	do {
+		*--p = static_cast<char>('0' + v % 10);
+		v /= 10;
+	} while (v);
+	return std::copy(p, tmp+sizeof(tmp), buffer);
+}
+
+char *NumFormat::format(float v, char *buffer) const {
+	if (!std::isfinite(v)) {
+		*buffer++ = '0';
+		return buffer;
+	}
+	if (decimals == shortest) {
+		return std::to_chars(buffer, buffer + max_length, v).ptr;
+	}
+	double d = static_cast<double>(v) * scale;
+	//very large numbers (out of range of the integer arithmetic)
+	if (std::abs(d) >= 1e18) {
+		int len = std::snprintf(buffer, max_length, "%.0f", static_cast<double>(v));
+		return buffer + std::min<int>(len, max_length-1);
+	}
+	long long n = std::llround(d);
+	if (n == 0) {
+		*buffer++ = '0';
+		return buffer;
+	}
+	if (n < 0) {
+		*buffer++ = '-';
+		n = -n;
+	}
+	unsigned long long ipart = static_cast<unsigned long long>(n / scale);
+	unsigned long long fpart = static_cast<unsigned long long>(n % scale);
+	buffer = writeUInt(ipart, buffer);
+	if (fpart) {
+		*buffer++ = '.';
+		int digits = decimals;
+		while (fpart % 10 == 0) {
+			fpart /= 10;
+			digits--;
+		}
+		char *end = buffer + digits;
+		while (end != buffer) {
+			*--end = static_cast<char>('0' + fpart % 10);
+			fpart /= 10;
+		}
+		buffer += digits;
+	}
+	return buffer;
+}
+
+std::ostream &operator<<(std::ostream &out, const NumFormat::Num &num) {
+	char buff[NumFormat::max_length];
+	char *end = num.fmt.format(num.v, buff);
+	out.write(buff, end - buff);
+	return out;
+}
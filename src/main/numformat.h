@@ -0,0 +1,61 @@
+/*
+ * numformat.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_NUMFORMAT_H_
+#define SRC_MAIN_NUMFORMAT_H_
+
+#include <cstddef>
+#include <ostream>
+
+///Formats numbers with fixed count of decimal places
+/**
+ * Formatting doesn't depend on the locale. Trailing zeroes are removed, so
+ * 1.50 is written as 1.5 and 2.00 is written as 2. Infinite numbers and NaN
+ * are written as 0. In the mode shortest, the number is written without
+ * rounding, using the shortest text which is read back as the same float
+ */
+class NumFormat {
+public:
+	///maximum count of decimal places
+	static constexpr int max_decimals = 6;
+	///shortest text without rounding (instead of count of decimal places)
+	static constexpr int shortest = -1;
+	///minimal size of the buffer, fits all digits of FLT_MAX with sign and terminator
+	static constexpr std::size_t max_length = 48;
+
+	///Construct formatter
+	/**
+	 * @param decimals count of decimal places (0 - max_decimals), or shortest
+	 */
+	explicit NumFormat(int decimals = 2);
+
+	///Formats number
+	/**
+	 * @param v number
+	 * @param buffer buffer, which must have at least max_length chars
+	 * @return pointer to the end of the number
+	 */
+	char *format(float v, char *buffer) const;
+
+	int getDecimals() const {return decimals;}
+
+	///Helper, which allows to write number to the stream - out << fmt(v)
+	struct Num {
+		const NumFormat &fmt;
+		float v;
+	};
+
+	Num operator()(float v) const {return Num{*this, v};}
+
+protected:
+	int decimals;
+	long long scale;
+};
+
+std::ostream &operator<<(std::ostream &out, const NumFormat::Num &num);
+
+#endif /* SRC_MAIN_NUMFORMAT_H_ */
@@ -0,0 +1,96 @@
+/*
+ * png_writer.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "png_writer.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+static void writeUInt32(std::ostream &out, std::uint32_t v) {
+	char buff[4] = {
+			static_cast<char>(v >> 24),
+			static_cast<char>(v >> 16),
+			static_cast<char>(v >> 8),
+			static_cast<char>(v)
+	};
+	out.write(buff, 4);
+}
+
+static void writeChunk(std::ostream &out, const char *type, const unsigned char *data, std::size_t size) {
+	writeUInt32(out, static_cast<std::uint32_t>(size));
+	out.write(type, 4);
+	out.write(reinterpret_cast<const char *>(data), size);
+	uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+	//crc32 with null buffer returns initial value
+	if (size) crc = crc32(crc, data, static_cast<uInt>(size));
+	writeUInt32(out, static_cast<std::uint32_t>(crc));
+}
+
+void writePNG(std::ostream &out, unsigned int width, unsigned int height, const unsigned char *rgb, int level) {
+	//size of IDAT chunk
+	static constexpr std::size_t chunk_size = 64*1024;
+	static const char signature[8] = {'\x89','P','N','G','\r','\n','\x1A','\n'};
+
+	out.write(signature, sizeof(signature));
+	unsigned char ihdr[13] = {
+			static_cast<unsigned char>(width >> 24), static_cast<unsigned char>(width >> 16),
+			static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width),
+			static_cast<unsigned char>(height >> 24), static_cast<unsigned char>(height >> 16),
+			static_cast<unsigned char>(height >> 8), static_cast<unsigned char>(height),
+			8,		//bit depth
+			2,		//color type RGB
+			0,0,0	//compression, filter, interlace
+	};
+	writeChunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+	z_stream strm = {};
+	if (deflateInit(&strm, level) != Z_OK) throw std::runtime_error("PNG: deflateInit failed");
+
+	std::size_t stride = static_cast<std::size_t>(width) * 3;
+	std::vector<unsigned char> row(stride+1);
+	std::vector<unsigned char> buffer(chunk_size);
+	strm.next_out = buffer.data();
+	strm.avail_out = static_cast<uInt>(buffer.size());
+
+	auto deflateData = [&](unsigned char *data, std::size_t size, int flush) {
+		strm.next_in = data;
+		strm.avail_in = static_cast<uInt>(size);
+		int r;
+		do {
+			r = deflate(&strm, flush);
+			if (r == Z_STREAM_ERROR) {
+				deflateEnd(&strm);
+				throw std::runtime_error("PNG: deflate failed");
+			}
+			if (strm.avail_out == 0) {
+				writeChunk(out, "IDAT", buffer.data(), buffer.size());
+				strm.next_out = buffer.data();
+				strm.avail_out = static_cast<uInt>(buffer.size());
+			}
+		} while (strm.avail_in || (flush == Z_FINISH && r != Z_STREAM_END));
+	};
+
+	//every row uses the filter Up (difference from the previous row)
+	for (unsigned int y = 0; y < height; y++) {
+		const unsigned char *cur = rgb + y * stride;
+		row[0] = 2;
+		if (y) {
+			const unsigned char *prev = cur - stride;
+			for (std::size_t i = 0; i < stride; i++) row[i+1] = static_cast<unsigned char>(cur[i] - prev[i]);
+		} else {
+			std::copy(cur, cur+stride, row.begin()+1);
+		}
+		deflateData(row.data(), row.size(), Z_NO_FLUSH);
+	}
+	deflateData(nullptr, 0, Z_FINISH);
+	deflateEnd(&strm);
+	std::size_t rest = buffer.size() - strm.avail_out;
+	if (rest) writeChunk(out, "IDAT", buffer.data(), rest);
+	writeChunk(out, "IEND", nullptr, 0);
+}
@@ -0,0 +1,23 @@
+/*
+ * png_writer.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_PNG_WRITER_H_
+#define SRC_MAIN_PNG_WRITER_H_
+
+#include <ostream>
+
+///Writes RGB image as PNG
+/**
+ * @param out output stream
+ * @param width width of the image
+ * @param height height of the image
+ * @param rgb pixels, 3 bytes per pixel, rows from top to bottom
+ * @param level compression level (0-9)
+ */
+void writePNG(std::ostream &out, unsigned int width, unsigned int height, const unsigned char *rgb, int level);
+
+#endif /* SRC_MAIN_PNG_WRITER_H_ */
@@ -0,0 +1,306 @@
+/*
+ * point_kernels.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "point_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POINT_KERNELS_X86 1
+#endif
+
+namespace point_kernels {
+
+//GCC vector extension - compiles to SSE on x86 and to NEON on ARM
+typedef float v4sf __attribute__((vector_size(16)));
+
+static inline v4sf vload(const float *p) {
+	v4sf r;
+	std::memcpy(&r, p, sizeof(r));
+	return r;
+}
+
+static inline void vstore(float *p, v4sf v) {
+	std::memcpy(p, &v, sizeof(v));
+}
+
+//same semantic as std::min and std::max
+static inline v4sf vmin(v4sf a, v4sf b) {return b < a ? b : a;}
+static inline v4sf vmax(v4sf a, v4sf b) {return a < b ? b : a;}
+
+void accumulateBounds(const float *x, const float *y, const float *width, std::size_t count, float bounds[4]) {
+	std::size_t i = 0;
+	float left = bounds[0], top = bounds[1], right = bounds[2], bottom = bounds[3];
+	if (count >= 4) {
+		v4sf vl = {left, left, left, left};
+		v4sf vt = {top, top, top, top};
+		v4sf vr = {right, right, right, right};
+		v4sf vb = {bottom, bottom, bottom, bottom};
+		for (; i + 4 <= count; i+=4) {
+			v4sf vx = vload(x+i);
+			v4sf vy = vload(y+i);
+			v4sf vw = vload(width+i);
+			vl = vmin(vl, vx - vw);
+			vt = vmin(vt, vy - vw);
+			vr = vmax(vr, vx + vw);
+			vb = vmax(vb, vy + vw);
+		}
+		for (int j = 0; j < 4; j++) {
+			left = std::min(left, vl[j]);
+			top = std::min(top, vt[j]);
+			right = std::max(right, vr[j]);
+			bottom = std::max(bottom, vb[j]);
+		}
+	}
+	for (; i < count; i++) {
+		left = std::min(left, x[i]-width[i]);
+		top = std::min(top, y[i]-width[i]);
+		right = std::max(right, x[i]+width[i]);
+		bottom = std::max(bottom, y[i]+width[i]);
+	}
+	bounds[0] = left;
+	bounds[1] = top;
+	bounds[2] = right;
+	bounds[3] = bottom;
+}
+
+void midpoints(float *col, std::size_t count) {
+	const v4sf half = {0.5f, 0.5f, 0.5f, 0.5f};
+	std::size_t i = 0;
+	//in place is safe - every block reads items which was not written yet
+	for (; i + 4 <= count; i+=4) {
+		vstore(col+i, (vload(col+i) + vload(col+i+1)) * half);
+	}
+	for (; i < count; i++) {
+		col[i] = (col[i] + col[i+1]) * 0.5f;
+	}
+}
+
+
+std::size_t smooth(float *col, std::size_t count, unsigned int passes) {
+	if (count <= 2) return count;
+	std::size_t interior = count - 2;
+	std::size_t p = std::min<std::size_t>(passes, interior);
+	float *a = col+1;
+	//the column is processed in tiles, all passes run above the tile while it is in the cache.
+	//When items below end are available, pass k can calculate items below end-k, because
+	//pass k-1 already calculated them. Every item is written after it was read by the next pass
+	for (std::size_t begin = 0; begin < interior; begin += smooth_tile) {
+		std::size_t end = std::min(begin + smooth_tile, interior);
+		for (std::size_t k = 1; k <= p && k < end; k++) {
+			std::size_t lo = begin > k?begin - k:0;
+			midpoints(a + lo, end - k - lo);
+		}
+	}
+	std::size_t newcount = count - p;
+	col[newcount-1] = col[count-1];
+	return newcount;
+}
+
+//squared distance of the point p from the segment a-b
+static inline float segmentDist2(float px, float py, float ax, float ay, float bx, float by) {
+	float dx = bx - ax;
+	float dy = by - ay;
+	float ex = px - ax;
+	float ey = py - ay;
+	float len2 = dx * dx + dy * dy;
+	if (len2 > 0) {
+		float t = std::clamp((ex * dx + ey * dy) / len2, 0.0f, 1.0f);
+		ex -= t * dx;
+		ey -= t * dy;
+	}
+	return ex * ex + ey * ey;
+}
+
+std::size_t simplify(const float *x, const float *y, std::size_t count, float tolerance,
+		unsigned char *keep, std::vector<std::size_t> &stack) {
+	if (count <= 2) {
+		std::fill(keep, keep+count, 1);
+		return count;
+	}
+	std::fill(keep, keep+count, 0);
+	keep[0] = 1;
+	keep[count-1] = 1;
+	std::size_t kept = 2;
+	float tol2 = tolerance * tolerance;
+	//stack contains pairs of indices (first, last) of the ranges to process
+	stack.clear();
+	stack.push_back(0);
+	stack.push_back(count-1);
+	while (!stack.empty()) {
+		std::size_t last = stack.back(); stack.pop_back();
+		std::size_t first = stack.back(); stack.pop_back();
+		float ax = x[first], ay = y[first], bx = x[last], by = y[last];
+		float maxd = tol2;
+		std::size_t sel = 0;
+		for (std::size_t i = first+1; i < last; i++) {
+			float d = segmentDist2(x[i], y[i], ax, ay, bx, by);
+			if (d > maxd) {
+				maxd = d;
+				sel = i;
+			}
+		}
+		if (sel) {
+			keep[sel] = 1;
+			kept++;
+			if (sel - first > 1) {
+				stack.push_back(first);
+				stack.push_back(sel);
+			}
+			if (last - sel > 1) {
+				stack.push_back(sel);
+				stack.push_back(last);
+			}
+		}
+	}
+	return kept;
+}
+
+std::size_t compact(float *col, const unsigned char *keep, std::size_t count) {
+	std::size_t j = 0;
+	for (std::size_t i = 0; i < count; i++) {
+		col[j] = col[i];
+		j += keep[i];
+	}
+	return j;
+}
+
+static constexpr std::size_t point_size = 6*sizeof(float);
+
+static void decodeScalar(const char *src, std::size_t count, bool swap_endian, float * const cols[6]) {
+	for (std::size_t i = 0; i < count; i++) {
+		for (int c = 0; c < 6; c++) {
+			std::uint32_t v;
+			std::memcpy(&v, src + c * sizeof(v), sizeof(v));
+			if (swap_endian) v = __builtin_bswap32(v);
+			std::memcpy(cols[c]+i, &v, sizeof(v));
+		}
+		src += point_size;
+	}
+}
+
+#ifdef POINT_KERNELS_X86
+
+//Both implementations decode a group of points using the same scheme. First four
+//floats of every point (x, y, speed, direction) are loaded into one register
+//and transposed 4x4, remaining two floats (width, pressure) are loaded as 64-bit
+//and transposed 4x2. AVX2 variant decodes two groups at once, one in each 128-bit lane
+
+__attribute__((target("ssse3")))
+static void decodeSSSE3(const char *src, std::size_t count, bool swap_endian, float * const cols[6]) {
+	const __m128i bswap = _mm_set_epi8(12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3);
+	std::size_t i = 0;
+	for (; i + 4 <= count; i+=4, src += 4*point_size) {
+		__m128i a[4], b[4];
+		for (int r = 0; r < 4; r++) {
+			a[r] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + r*point_size));
+			b[r] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + r*point_size + 16));
+			if (swap_endian) {
+				a[r] = _mm_shuffle_epi8(a[r], bswap);
+				b[r] = _mm_shuffle_epi8(b[r], bswap);
+			}
+		}
+		__m128 t0 = _mm_unpacklo_ps(_mm_castsi128_ps(a[0]), _mm_castsi128_ps(a[1]));
+		__m128 t1 = _mm_unpacklo_ps(_mm_castsi128_ps(a[2]), _mm_castsi128_ps(a[3]));
+		__m128 t2 = _mm_unpackhi_ps(_mm_castsi128_ps(a[0]), _mm_castsi128_ps(a[1]));
+		__m128 t3 = _mm_unpackhi_ps(_mm_castsi128_ps(a[2]), _mm_castsi128_ps(a[3]));
+		__m128 u0 = _mm_unpacklo_ps(_mm_castsi128_ps(b[0]), _mm_castsi128_ps(b[1]));
+		__m128 u1 = _mm_unpacklo_ps(_mm_castsi128_ps(b[2]), _mm_castsi128_ps(b[3]));
+		_mm_storeu_ps(cols[0]+i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(1,0,1,0)));
+		_mm_storeu_ps(cols[1]+i, _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3,2,3,2)));
+		_mm_storeu_ps(cols[2]+i, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(1,0,1,0)));
+		_mm_storeu_ps(cols[3]+i, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(3,2,3,2)));
+		_mm_storeu_ps(cols[4]+i, _mm_shuffle_ps(u0, u1, _MM_SHUFFLE(1,0,1,0)));
+		_mm_storeu_ps(cols[5]+i, _mm_shuffle_ps(u0, u1, _MM_SHUFFLE(3,2,3,2)));
+	}
+	if (i < count) {
+		float * const rest[6] = {cols[0]+i, cols[1]+i, cols[2]+i, cols[3]+i, cols[4]+i, cols[5]+i};
+		decodeScalar(src, count - i, swap_endian, rest);
+	}
+}
+
+__attribute__((target("avx2")))
+static void decodeAVX2(const char *src, std::size_t count, bool swap_endian, float * const cols[6]) {
+	const __m256i bswap = _mm256_set_epi8(12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3,
+										  12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3);
+	std::size_t i = 0;
+	for (; i + 8 <= count; i+=8, src += 8*point_size) {
+		__m256 a[4], b[4];
+		for (int r = 0; r < 4; r++) {
+			const char *lo = src + r*point_size;
+			const char *hi = lo + 4*point_size;
+			__m256i va = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(lo))),
+					_mm_loadu_si128(reinterpret_cast<const __m128i *>(hi)), 1);
+			__m256i vb = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadl_epi64(reinterpret_cast<const __m128i *>(lo + 16))),
+					_mm_loadl_epi64(reinterpret_cast<const __m128i *>(hi + 16)), 1);
+			if (swap_endian) {
+				va = _mm256_shuffle_epi8(va, bswap);
+				vb = _mm256_shuffle_epi8(vb, bswap);
+			}
+			a[r] = _mm256_castsi256_ps(va);
+			b[r] = _mm256_castsi256_ps(vb);
+		}
+		__m256 t0 = _mm256_unpacklo_ps(a[0], a[1]);
+		__m256 t1 = _mm256_unpacklo_ps(a[2], a[3]);
+		__m256 t2 = _mm256_unpackhi_ps(a[0], a[1]);
+		__m256 t3 = _mm256_unpackhi_ps(a[2], a[3]);
+		__m256 u0 = _mm256_unpacklo_ps(b[0], b[1]);
+		__m256 u1 = _mm256_unpacklo_ps(b[2], b[3]);
+		_mm256_storeu_ps(cols[0]+i, _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1,0,1,0)));
+		_mm256_storeu_ps(cols[1]+i, _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3,2,3,2)));
+		_mm256_storeu_ps(cols[2]+i, _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1,0,1,0)));
+		_mm256_storeu_ps(cols[3]+i, _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3,2,3,2)));
+		_mm256_storeu_ps(cols[4]+i, _mm256_shuffle_ps(u0, u1, _MM_SHUFFLE(1,0,1,0)));
+		_mm256_storeu_ps(cols[5]+i, _mm256_shuffle_ps(u0, u1, _MM_SHUFFLE(3,2,3,2)));
+	}
+	if (i < count) {
+		float * const rest[6] = {cols[0]+i, cols[1]+i, cols[2]+i, cols[3]+i, cols[4]+i, cols[5]+i};
+		decodeSSSE3(src, count - i, swap_endian, rest);
+	}
+}
+
+#endif
+
+bool isSupported(DecodeImpl impl) {
+	switch (impl) {
+	case DecodeImpl::automatic:
+	case DecodeImpl::scalar: return true;
+#ifdef POINT_KERNELS_X86
+	case DecodeImpl::ssse3: return __builtin_cpu_supports("ssse3");
+	case DecodeImpl::avx2: return __builtin_cpu_supports("avx2");
+#endif
+	default: return false;
+	}
+}
+
+DecodeImpl bestImpl() {
+	static const DecodeImpl best = []{
+		if (isSupported(DecodeImpl::avx2)) return DecodeImpl::avx2;
+		if (isSupported(DecodeImpl::ssse3)) return DecodeImpl::ssse3;
+		return DecodeImpl::scalar;
+	}();
+	return best;
+}
+
+void decodePoints(const char *src, std::size_t count, bool swap_endian, float * const cols[6], DecodeImpl impl) {
+	if (impl == DecodeImpl::automatic) impl = bestImpl();
+	else if (!isSupported(impl)) impl = DecodeImpl::scalar;
+	switch (impl) {
+#ifdef POINT_KERNELS_X86
+	case DecodeImpl::avx2: decodeAVX2(src, count, swap_endian, cols);break;
+	case DecodeImpl::ssse3: decodeSSSE3(src, count, swap_endian, cols);break;
+#endif
+	default: decodeScalar(src, count, swap_endian, cols);break;
+	}
+}
+
+}
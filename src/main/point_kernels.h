@@ -0,0 +1,110 @@
+/*
+ * point_kernels.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_POINT_KERNELS_H_
+#define SRC_MAIN_POINT_KERNELS_H_
+
+#include <cstddef>
+#include <vector>
+
+///Vectorized kernels working above point columns (see Drawing::Points)
+namespace point_kernels {
+
+///Extends the bounds by the points
+/**
+ * For every point, the rectangle (x-width, y-width, x+width, y+width) is merged to the bounds
+ *
+ * @param x column x
+ * @param y column y
+ * @param width column width
+ * @param count count of points
+ * @param bounds in/out bounds - left, top, right, bottom. It must be initialized
+ */
+void accumulateBounds(const float *x, const float *y, const float *width, std::size_t count, float bounds[4]);
+
+///Calculates midpoints in place
+/**
+ * col[i] = (col[i] + col[i+1]) * 0.5 for i in 0..count-1. The
+ * column must have count+1 items
+ */
+void midpoints(float *col, std::size_t count);
+
+///Count of items of the tile processed by all passes of smooth()
+static constexpr std::size_t smooth_tile = 1024;
+
+///Applies midpoint smoothing passes in place in single sweep
+/**
+ * First and last item are kept, each pass replaces interior items by the midpoints
+ * of the neighbours, so each pass removes one item. The column is processed in
+ * tiles by midpoints(), result is same as repeated calling of midpoints()
+ *
+ * @param col column
+ * @param count count of items
+ * @param passes count of passes. Passes stop when only two items remain
+ * @return new count of items
+ */
+std::size_t smooth(float *col, std::size_t count, unsigned int passes);
+
+///Selects points kept by Ramer-Douglas-Peucker simplification
+/**
+ * Implementation is iterative, it doesn't allocate memory when the stack has
+ * enough capacity
+ *
+ * @param x column x
+ * @param y column y
+ * @param count count of points
+ * @param tolerance maximal distance of removed point from the simplified polyline
+ * @param keep receives count of flags, 1 - point is kept, 0 - point is removed
+ * @param stack scratch buffer, can be reused between calls
+ * @return count of kept points
+ */
+std::size_t simplify(const float *x, const float *y, std::size_t count, float tolerance,
+		unsigned char *keep, std::vector<std::size_t> &stack);
+
+///Removes items of the column, which are not marked in keep
+/**
+ * @param col column
+ * @param keep flags (see simplify)
+ * @param count count of items
+ * @return new count of items
+ */
+std::size_t compact(float *col, const unsigned char *keep, std::size_t count);
+
+
+///Implementation of the point decoder
+enum class DecodeImpl {
+	///choose best available implementation at runtime
+	automatic,
+	///portable implementation
+	scalar,
+	///SSSE3 implementation (x86 only)
+	ssse3,
+	///AVX2 implementation (x86 only)
+	avx2
+};
+
+///Decodes binary points to the columns
+/**
+ * @param src source data - count of records, each record has 6 floats (x, y, speed, direction, width, pressure)
+ * @param count count of points
+ * @param swap_endian true to swap byte order
+ * @param cols six columns in order x, y, speed, direction, width, pressure. Each
+ * column must have space for count items
+ * @param impl implementation (for benchmarking). When implementation is not
+ * supported by the CPU, scalar implementation is used
+ */
+void decodePoints(const char *src, std::size_t count, bool swap_endian, float * const cols[6], DecodeImpl impl = DecodeImpl::automatic);
+
+///Returns true, when implementation is supported by current CPU
+bool isSupported(DecodeImpl impl);
+
+///Returns implementation which is used for DecodeImpl::automatic
+DecodeImpl bestImpl();
+
+}
+
+#endif /* SRC_MAIN_POINT_KERNELS_H_ */
@@ -0,0 +1,406 @@
+/*
+ * raster.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "rmparser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "csscolor.h"
+#include "png_writer.h"
+#include "worker_pool.h"
+
+namespace {
+
+struct RGB {
+	float r, g, b;
+};
+
+///Renders one tile of the bitmap
+/**
+ * Coordinates are in pixels relative to the top-left corner of the tile. Lines
+ * of the layer are drawn to the layer buffer (premultiplied RGBA), erasers clear
+ * the layer buffer. Finished layer is composited over the page
+ */
+class TileRasterizer {
+public:
+	void reset(int w, int h);
+	///Starts new line, clears coverage
+	void beginLine();
+	///Draws segment with round caps, butt caps can be enabled for both ends
+	void capsule(float ax, float ay, float bx, float by, float r, float opacity, bool butt_a, bool butt_b);
+	///Fills polygon (nonzero rule)
+	void polygon(const float *x, const float *y, std::size_t count);
+	///Draws coverage of the line with color to the layer
+	void paint(const RGB &color, float alpha);
+	///Removes coverage of the line from the layer
+	void erase();
+	///Clears the layer
+	void beginLayer();
+	///Composites the layer over the page
+	void endLayer();
+	///Stores tile to the bitmap
+	void store(unsigned char *rgb, std::size_t stride) const;
+
+protected:
+	int w = 0, h = 0;
+	std::vector<float> page;
+	std::vector<float> layer;
+	std::vector<float> cov;
+	//touched area of the coverage and the layer
+	int cx1, cy1, cx2, cy2;
+	int lx1, ly1, lx2, ly2;
+	//crossings of the scan line (polygon)
+	std::vector<std::pair<float, int> > crossings;
+
+	void touch(int x1, int y1, int x2, int y2);
+};
+
+void TileRasterizer::reset(int w, int h) {
+	this->w = w;
+	this->h = h;
+	std::size_t sz = static_cast<std::size_t>(w) * h;
+	page.assign(sz*3, 1.0f);
+	layer.assign(sz*4, 0.0f);
+	cov.assign(sz, 0.0f);
+	cx1 = cy1 = lx1 = ly1 = 0;
+	cx2 = cy2 = lx2 = ly2 = -1;
+}
+
+void TileRasterizer::touch(int x1, int y1, int x2, int y2) {
+	cx1 = std::min(cx1, x1); cy1 = std::min(cy1, y1);
+	cx2 = std::max(cx2, x2); cy2 = std::max(cy2, y2);
+}
+
+void TileRasterizer::beginLine() {
+	for (int y = cy1; y <= cy2; y++) {
+		std::fill(cov.begin() + y * w + cx1, cov.begin() + y * w + cx2 + 1, 0.0f);
+	}
+	cx1 = w; cy1 = h;
+	cx2 = cy2 = -1;
+}
+
+void TileRasterizer::beginLayer() {
+	for (int y = ly1; y <= ly2; y++) {
+		std::fill(layer.begin() + (y * w + lx1) * 4, layer.begin() + (y * w + lx2 + 1) * 4, 0.0f);
+	}
+	lx1 = w; ly1 = h;
+	lx2 = ly2 = -1;
+}
+
+void TileRasterizer::capsule(float ax, float ay, float bx, float by, float r, float opacity, bool butt_a, bool butt_b) {
+	if (!(r > 0) || !(opacity > 0)) return;
+	int x1 = std::max(0, static_cast<int>(std::floor(std::min(ax, bx) - r - 1)));
+	int y1 = std::max(0, static_cast<int>(std::floor(std::min(ay, by) - r - 1)));
+	int x2 = std::min(w - 1, static_cast<int>(std::ceil(std::max(ax, bx) + r + 1)));
+	int y2 = std::min(h - 1, static_cast<int>(std::ceil(std::max(ay, by) + r + 1)));
+	if (x1 > x2 || y1 > y2) return;
+	touch(x1, y1, x2, y2);
+	opacity = std::min(opacity, 1.0f);
+	float dx = bx - ax;
+	float dy = by - ay;
+	float len2 = dx * dx + dy * dy;
+	float len = std::sqrt(len2);
+	for (int y = y1; y <= y2; y++) {
+		float py = y + 0.5f;
+		float *row = cov.data() + y * w;
+		for (int x = x1; x <= x2; x++) {
+			float px = x + 0.5f;
+			float ex = px - ax;
+			float ey = py - ay;
+			//position along the segment (in pixels) and the distance from the segment
+			float t = len2 > 0 ? (ex * dx + ey * dy) / len : 0;
+			float d;
+			float along = 1.0f;
+			if (t < 0) {
+				if (butt_a) {
+					d = std::abs(ex * dy - ey * dx) / len;
+					along = std::max(0.0f, 0.5f + t);
+				} else {
+					d = std::sqrt(ex * ex + ey * ey);
+				}
+			} else if (t > len) {
+				if (butt_b) {
+					d = std::abs(ex * dy - ey * dx) / len;
+					along = std::max(0.0f, 0.5f - (t - len));
+				} else {
+					float fx = px - bx, fy = py - by;
+					d = std::sqrt(fx * fx + fy * fy);
+				}
+			} else {
+				d = len > 0 ? std::abs(ex * dy - ey * dx) / len : std::sqrt(ex * ex + ey * ey);
+			}
+			//coverage of the pixel by the band of width 2r (box filter)
+			float c = std::min(d + r, 0.5f) - std::max(d - r, -0.5f);
+			if (c <= 0) continue;
+			c = std::min(c, 1.0f) * std::min(along, 1.0f) * opacity;
+			row[x] = std::max(row[x], c);
+		}
+	}
+}
+
+void TileRasterizer::polygon(const float *x, const float *y, std::size_t count) {
+	//count of the sub-scan lines per pixel
+	static constexpr int subrows = 4;
+	if (count < 3) return;
+	float miny = *std::min_element(y, y + count);
+	float maxy = *std::max_element(y, y + count);
+	int y1 = std::max(0, static_cast<int>(std::floor(miny)));
+	int y2 = std::min(h - 1, static_cast<int>(std::ceil(maxy)));
+	if (y1 > y2) return;
+	int tx1 = w, tx2 = -1;
+	for (int yy = y1; yy <= y2; yy++) {
+		float *row = cov.data() + yy * w;
+		for (int k = 0; k < subrows; k++) {
+			float sy = yy + (k + 0.5f) / subrows;
+			crossings.clear();
+			for (std::size_t i = 0; i < count; i++) {
+				std::size_t j = i + 1 == count ? 0 : i + 1;
+				float ay = y[i], by = y[j];
+				if ((ay <= sy) == (by <= sy)) continue;
+				float sx = x[i] + (sy - ay) * (x[j] - x[i]) / (by - ay);
+				crossings.push_back({sx, ay < by ? 1 : -1});
+			}
+			std::sort(crossings.begin(), crossings.end());
+			int winding = 0;
+			for (std::size_t i = 0; i + 1 < crossings.size(); i++) {
+				winding += crossings[i].second;
+				if (!winding) continue;
+				float sx1 = std::max(0.0f, crossings[i].first);
+				float sx2 = std::min(static_cast<float>(w), crossings[i+1].first);
+				if (sx1 >= sx2) continue;
+				int px1 = static_cast<int>(sx1);
+				int px2 = std::min(w - 1, static_cast<int>(sx2));
+				tx1 = std::min(tx1, px1);
+				tx2 = std::max(tx2, px2);
+				for (int px = px1; px <= px2; px++) {
+					float c = std::min(sx2, px + 1.0f) - std::max(sx1, static_cast<float>(px));
+					if (c > 0) row[px] = std::min(1.0f, row[px] + c / subrows);
+				}
+			}
+		}
+	}
+	if (tx1 <= tx2) touch(tx1, y1, tx2, y2);
+}
+
+void TileRasterizer::paint(const RGB &color, float alpha) {
+	if (cx1 > cx2) return;
+	lx1 = std::min(lx1, cx1); ly1 = std::min(ly1, cy1);
+	lx2 = std::max(lx2, cx2); ly2 = std::max(ly2, cy2);
+	for (int y = cy1; y <= cy2; y++) {
+		const float *c = cov.data() + y * w;
+		float *l = layer.data() + y * w * 4;
+		for (int x = cx1; x <= cx2; x++) {
+			float a = c[x] * alpha;
+			if (a <= 0) continue;
+			float ia = 1.0f - a;
+			float *p = l + x * 4;
+			p[0] = color.r * a + p[0] * ia;
+			p[1] = color.g * a + p[1] * ia;
+			p[2] = color.b * a + p[2] * ia;
+			p[3] = a + p[3] * ia;
+		}
+	}
+}
+
+void TileRasterizer::erase() {
+	//only area which contains something can be erased
+	int x1 = std::max(cx1, lx1), x2 = std::min(cx2, lx2);
+	int y1 = std::max(cy1, ly1), y2 = std::min(cy2, ly2);
+	for (int y = y1; y <= y2; y++) {
+		const float *c = cov.data() + y * w;
+		float *l = layer.data() + y * w * 4;
+		for (int x = x1; x <= x2; x++) {
+			float ia = 1.0f - c[x];
+			float *p = l + x * 4;
+			p[0] *= ia; p[1] *= ia; p[2] *= ia; p[3] *= ia;
+		}
+	}
+}
+
+void TileRasterizer::endLayer() {
+	for (int y = ly1; y <= ly2; y++) {
+		const float *l = layer.data() + y * w * 4;
+		float *pg = page.data() + y * w * 3;
+		for (int x = lx1; x <= lx2; x++) {
+			const float *p = l + x * 4;
+			float ia = 1.0f - p[3];
+			float *q = pg + x * 3;
+			q[0] = p[0] + q[0] * ia;
+			q[1] = p[1] + q[1] * ia;
+			q[2] = p[2] + q[2] * ia;
+		}
+	}
+}
+
+void TileRasterizer::store(unsigned char *rgb, std::size_t stride) const {
+	for (int y = 0; y < h; y++) {
+		const float *pg = page.data() + y * w * 3;
+		unsigned char *out = rgb + y * stride;
+		for (int i = 0; i < w * 3; i++) {
+			out[i] = static_cast<unsigned char>(std::clamp(static_cast<int>(pg[i] * 255.0f + 0.5f), 0, 255));
+		}
+	}
+}
+
+}
+
+bool Drawing::bitmapSize(const PngOptions &opts, std::size_t max_pixels, unsigned int &width, unsigned int &height) {
+	const Box &vp = opts.viewport;
+	if (!(opts.scale > 0) || !vp.valid()) return false;
+	//side is checked in float, huge or infinite value can't be converted
+	auto side = [&](float size, unsigned int &out) {
+		float v = std::max(1.0f, std::ceil(size * opts.scale - 0.001f));
+		if (!(v <= static_cast<float>(max_pixels))) return false;
+		out = static_cast<unsigned int>(v);
+		return true;
+	};
+	return side(vp.right - vp.left, width) && side(vp.bottom - vp.top, height)
+			&& static_cast<std::uint64_t>(width) * height <= max_pixels;
+}
+
+void Drawing::rasterize(Bitmap &bmp, const ColorDef &def, const PngOptions &opts, WorkerPool *pool) {
+	//size of the tile in pixels
+	static constexpr int tile_size = 256;
+
+	const Box &vp = opts.viewport;
+	float scale = opts.scale;
+	if (!bitmapSize(opts, max_bitmap_pixels, bmp.width, bmp.height)) throw std::runtime_error("Invalid scale or viewport");
+	std::size_t stride = static_cast<std::size_t>(bmp.width) * 3;
+	bmp.rgb.resize(stride * bmp.height);
+
+	const LineIndex &index = getIndex();
+	//Colors of the lines. Stroke width of some brushes is defined by the first
+	//point, so bounds of the lines can be smaller, this is covered by the margin
+	std::vector<std::vector<RGB> > colors(content.layers.size());
+	float margin = 1.0f / scale;
+	for (std::size_t l = 0; l < content.layers.size(); l++) {
+		const auto &lines = content.layers[l].lines;
+		colors[l].resize(lines.size());
+		for (std::size_t i = 0; i < lines.size(); i++) {
+			const Line &ln = lines[i];
+			CSSColor c(def.getColor(static_cast<int>(l+1), ln.type, ln.color));
+			colors[l][i] = {c.r, c.g, c.b};
+			if (!ln.points.empty()) margin = std::max(margin, ln.points.width()[0]);
+		}
+	}
+
+	unsigned int tcols = (bmp.width + tile_size - 1) / tile_size;
+	unsigned int trows = (bmp.height + tile_size - 1) / tile_size;
+
+	auto renderTile = [&](std::size_t tile) {
+		static thread_local TileRasterizer rst;
+		static thread_local std::vector<LineIndex::Entry> sel;
+		static thread_local std::vector<float> tx, ty;
+
+		int x0 = static_cast<int>(tile % tcols) * tile_size;
+		int y0 = static_cast<int>(tile / tcols) * tile_size;
+		int w = std::min(tile_size, static_cast<int>(bmp.width) - x0);
+		int h = std::min(tile_size, static_cast<int>(bmp.height) - y0);
+		rst.reset(w, h);
+		Box tbox {
+			vp.left + x0 / scale - margin,
+			vp.top + y0 / scale - margin,
+			vp.left + (x0 + w) / scale + margin,
+			vp.top + (y0 + h) / scale + margin
+		};
+		index.find(tbox, sel);
+		//transformation from page to the tile
+		float ox = vp.left + x0 / scale;
+		float oy = vp.top + y0 / scale;
+
+		auto iter = sel.begin();
+		while (iter != sel.end()) {
+			std::uint32_t l = iter->layer;
+			rst.beginLayer();
+			for (; iter != sel.end() && iter->layer == l; ++iter) {
+				const Line &ln = content.layers[l].lines[iter->line];
+				const RGB &color = colors[l][iter->line];
+				std::size_t cnt = ln.points.size();
+				if (cnt == 0) continue;
+				tx.resize(cnt);
+				ty.resize(cnt);
+				const float *x = ln.points.x();
+				const float *y = ln.points.y();
+				for (std::size_t i = 0; i < cnt; i++) {
+					tx[i] = (x[i] - ox) * scale;
+					ty[i] = (y[i] - oy) * scale;
+				}
+				//draws polyline with the constant width (path starts by zero length segment)
+				auto stroke = [&](float width, bool butt) {
+					float r = width * scale * 0.5f;
+					if (cnt == 1) {
+						if (!butt) rst.capsule(tx[0], ty[0], tx[0], ty[0], r, 1.0f, false, false);
+						return;
+					}
+					for (std::size_t i = 1; i < cnt; i++) {
+						rst.capsule(tx[i-1], ty[i-1], tx[i], ty[i], r, 1.0f, butt && i == 1, butt && i == cnt-1);
+					}
+				};
+				float w0 = ln.points.width()[0];
+				rst.beginLine();
+				switch (ln.type) {
+				case Brush::Eraser:
+					stroke(w0, false);
+					rst.erase();
+					break;
+				case Brush::EraseArea:
+					rst.polygon(tx.data(), ty.data(), cnt);
+					stroke(w0, false);
+					rst.erase();
+					break;
+				case Brush::Highlighter:
+					stroke(w0, true);
+					rst.paint(color, 0.25f);
+					break;
+				case Brush::Fineliner:
+					stroke(w0 * width_factor, false);
+					rst.paint(color, 1.0f);
+					break;
+				case Brush::BallPoint:
+				case Brush::Brush:
+				case Brush::Calligraphy:
+				case Brush::Marker:
+				case Brush::Pen:
+				case Brush::SharpPencil:
+				case Brush::TiltPencil: {
+					const float *pw = ln.points.width();
+					const float *pp = ln.points.pressure();
+					//single point is drawn as a dot (as in SVG)
+					if (cnt == 1) {
+						rst.capsule(tx[0], ty[0], tx[0], ty[0], pw[0] * width_factor * scale * 0.5f,
+								brushOpacity(ln.type, pp[0]), false, false);
+					}
+					for (std::size_t i = 1; i < cnt; i++) {
+						rst.capsule(tx[i-1], ty[i-1], tx[i], ty[i], pw[i] * width_factor * scale * 0.5f,
+								brushOpacity(ln.type, pp[i]), false, false);
+					}
+					rst.paint(color, 1.0f);
+				} break;
+				default:
+					break;
+				}
+			}
+			rst.endLayer();
+		}
+		rst.store(bmp.rgb.data() + y0 * stride + x0 * 3, stride);
+	};
+
+	std::size_t tiles = static_cast<std::size_t>(tcols) * trows;
+	if (pool && pool->getThreads() > 1 && tiles > 1) {
+		pool->parallel_for(tiles, renderTile);
+	} else {
+		for (std::size_t i = 0; i < tiles; i++) renderTile(i);
+	}
+}
+
+void Drawing::render_png(std::ostream &out, const ColorDef &def, const PngOptions &opts, WorkerPool *pool) {
+	Bitmap bmp;
+	rasterize(bmp, def, opts, pool);
+	writePNG(out, bmp.width, bmp.height, bmp.rgb.data(), opts.level);
+}
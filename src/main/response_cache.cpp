@@ -0,0 +1,84 @@
+/*
+ * response_cache.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "response_cache.h"
+
+#include <functional>
+#include <imtjson/object.h>
+
+ResponseCache::ResponseCache(std::size_t budget):shard_budget(budget / shard_count) {}
+
+ResponseCache::Shard &ResponseCache::getShard(const std::string &key) {
+	return shards[std::hash<std::string>()(key) % shard_count];
+}
+
+std::size_t ResponseCache::entrySize(const std::string &key, const Entry &e) {
+	return key.size() + e.content_type.size() + e.content_encoding.size() + e.body.size() + entry_overhead;
+}
+
+ResponseCache::PEntry ResponseCache::find(const std::string &key) {
+	if (!enabled()) return nullptr;
+	Shard &sh = getShard(key);
+	std::lock_guard _(sh.mx);
+	auto iter = sh.map.find(key);
+	if (iter == sh.map.end()) {
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	sh.lru.splice(sh.lru.begin(), sh.lru, iter->second);
+	hits.fetch_add(1, std::memory_order_relaxed);
+	return iter->second->second;
+}
+
+void ResponseCache::store(const std::string &key, std::string_view content_type, std::string_view content_encoding, std::string &&body) {
+	if (!enabled()) return;
+	auto e = std::make_shared<Entry>();
+	e->content_type = content_type;
+	e->content_encoding = content_encoding;
+	e->body = std::move(body);
+	std::size_t sz = entrySize(key, *e);
+	if (sz > shard_budget) return;
+
+	Shard &sh = getShard(key);
+	std::lock_guard _(sh.mx);
+	auto iter = sh.map.find(key);
+	if (iter != sh.map.end()) {
+		sh.size -= entrySize(key, *iter->second->second);
+		sh.lru.erase(iter->second);
+		sh.map.erase(iter);
+	}
+	while (sh.size + sz > shard_budget) {
+		auto &last = sh.lru.back();
+		sh.size -= entrySize(last.first, *last.second);
+		sh.map.erase(last.first);
+		sh.lru.pop_back();
+		evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+	sh.lru.emplace_front(key, std::move(e));
+	//key of the map references the key stored in the list
+	sh.map.emplace(sh.lru.front().first, sh.lru.begin());
+	sh.size += sz;
+	stores.fetch_add(1, std::memory_order_relaxed);
+}
+
+json::Value ResponseCache::getStats() const {
+	std::size_t size = 0;
+	std::size_t entries = 0;
+	for (const Shard &sh: shards) {
+		std::lock_guard _(sh.mx);
+		size += sh.size;
+		entries += sh.map.size();
+	}
+	return json::Object
+			("budget", shard_budget * shard_count)
+			("size", size)
+			("entries", entries)
+			("hits", hits.load(std::memory_order_relaxed))
+			("misses", misses.load(std::memory_order_relaxed))
+			("stores", stores.load(std::memory_order_relaxed))
+			("evictions", evictions.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,88 @@
+/*
+ * response_cache.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_RESPONSE_CACHE_H_
+#define SRC_MAIN_RESPONSE_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <imtjson/value.h>
+
+///Cache of finished response bodies
+/**
+ * The cache is divided to shards, each shard has own lock and LRU list, and
+ * receives equal part of the budget. The key must contain everything the
+ * response depends on (including version of the source files), outdated
+ * entries are not removed, they are evicted as least recently used
+ */
+class ResponseCache {
+public:
+	struct Entry {
+		std::string content_type;
+		///Content-Encoding of the body, empty - not compressed
+		std::string content_encoding;
+		std::string body;
+	};
+
+	using PEntry = std::shared_ptr<const Entry>;
+
+	///Count of shards
+	static constexpr std::size_t shard_count = 16;
+	///Estimated memory overhead of the entry
+	static constexpr std::size_t entry_overhead = 128;
+
+	///Construct cache
+	/**
+	 * @param budget total count of bytes of the entries. Set 0 to disable the cache
+	 */
+	ResponseCache(std::size_t budget);
+
+	bool enabled() const {return shard_budget > 0;}
+	///Returns largest body, which can be stored
+	std::size_t maxEntrySize() const {return shard_budget;}
+
+	///Finds entry
+	/**
+	 * @return entry or nullptr when not found. Entry is marked as most recently used
+	 */
+	PEntry find(const std::string &key);
+	///Stores entry, replaces existing entry. Entry is not stored when it exceeds the limit
+	void store(const std::string &key, std::string_view content_type, std::string_view content_encoding, std::string &&body);
+
+	json::Value getStats() const;
+
+protected:
+	struct Shard {
+		using LRUList = std::list<std::pair<std::string, PEntry> >;
+
+		mutable std::mutex mx;
+		//front - most recently used
+		LRUList lru;
+		std::unordered_map<std::string_view, LRUList::iterator> map;
+		std::size_t size = 0;
+	};
+
+	std::size_t shard_budget;
+	Shard shards[shard_count];
+
+	std::atomic<std::uint64_t> hits{0};
+	std::atomic<std::uint64_t> misses{0};
+	std::atomic<std::uint64_t> stores{0};
+	std::atomic<std::uint64_t> evictions{0};
+
+	Shard &getShard(const std::string &key);
+	static std::size_t entrySize(const std::string &key, const Entry &e);
+};
+
+#endif /* SRC_MAIN_RESPONSE_CACHE_H_ */
@@ -0,0 +1,237 @@
+/*
+ * response_writer.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "response_writer.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <zlib.h>
+#include <imtjson/object.h>
+
+struct ResponseWriter::Deflate {
+	z_stream strm = {};
+	std::unique_ptr<unsigned char[]> out;
+
+	Deflate(int level, bool gzip):out(new unsigned char[chunk_size]) {
+		//windowBits+16 - gzip header
+		if (deflateInit2(&strm, level, Z_DEFLATED, gzip?15+16:15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error("ResponseWriter: deflateInit failed");
+		}
+	}
+	~Deflate() {
+		deflateEnd(&strm);
+	}
+};
+
+void ResponseStats::record(std::uint64_t bytes, std::uint64_t chunks) {
+	responses.fetch_add(1, std::memory_order_relaxed);
+	this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+	this->chunks.fetch_add(chunks, std::memory_order_relaxed);
+	std::uint64_t l = largest.load(std::memory_order_relaxed);
+	while (l < bytes && !largest.compare_exchange_weak(l, bytes, std::memory_order_relaxed));
+}
+
+json::Value ResponseStats::toJSON() const {
+	std::uint64_t r = responses.load(std::memory_order_relaxed);
+	std::uint64_t b = bytes.load(std::memory_order_relaxed);
+	std::uint64_t c = chunks.load(std::memory_order_relaxed);
+	return json::Object
+			("responses", r)
+			("bytes", b)
+			("chunks", c)
+			("largest_response", largest.load(std::memory_order_relaxed))
+			("avg_bytes", r?static_cast<double>(b)/r:0.0)
+			("avg_chunks", r?static_cast<double>(c)/r:0.0);
+}
+
+ResponseWriter::ResponseWriter(userver::Stream &&stream, ResponseStats &stats)
+	:stream(std::move(stream))
+	,stats(stats)
+	,buffer(new char[chunk_size])
+	,uncaught(std::uncaught_exceptions()) {
+	setp(buffer.get(), buffer.get()+chunk_size);
+}
+
+ResponseWriter::ResponseWriter(userver::HttpServerRequest &req, ResponseStats &stats, ContentEncoding encoding, const CompressionConfig &cfg)
+	:req(&req)
+	,stats(stats)
+	,encoding(encoding)
+	,cfg(cfg)
+	,buffer(new char[chunk_size])
+	,uncaught(std::uncaught_exceptions()) {
+	setp(buffer.get(), buffer.get()+chunk_size);
+}
+
+ResponseWriter::~ResponseWriter() {
+	//rendering failed, the body is incomplete
+	if (std::uncaught_exceptions() > uncaught) return;
+	try {
+		finish();
+	} catch (...) {
+
+	}
+}
+
+void ResponseWriter::start(std::size_t size) {
+	if (req) {
+		//the whole body is known, when the response is being finished
+		if (encoding != ContentEncoding::identity && (cfg.level <= 0 || (finishing && size < cfg.min_size))) {
+			encoding = ContentEncoding::identity;
+		}
+		if (encoding != ContentEncoding::identity) {
+			deflate = std::make_unique<Deflate>(std::min(cfg.level, 9), encoding == ContentEncoding::gzip);
+			req->set("Content-Encoding", encodingName(encoding));
+		}
+		stream.emplace(req->send());
+	}
+}
+
+void ResponseWriter::writeBlock(const std::string_view &data) {
+	if (data.empty()) return;
+	if (!stream) start(data.size());
+	if (deflate) compress(data, false);
+	else sendBlock(data);
+}
+
+void ResponseWriter::compress(const std::string_view &data, bool last) {
+	z_stream &strm = deflate->strm;
+	strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+	strm.avail_in = static_cast<uInt>(data.size());
+	int flush = last?Z_FINISH:Z_NO_FLUSH;
+	int r;
+	do {
+		strm.next_out = deflate->out.get();
+		strm.avail_out = static_cast<uInt>(chunk_size);
+		r = ::deflate(&strm, flush);
+		if (r == Z_STREAM_ERROR) throw std::runtime_error("ResponseWriter: deflate failed");
+		sendBlock(std::string_view(reinterpret_cast<const char *>(deflate->out.get()), chunk_size - strm.avail_out));
+	} while (strm.avail_out == 0 || (last && r != Z_STREAM_END));
+}
+
+void ResponseWriter::sendBlock(const std::string_view &data) {
+	if (data.empty()) return;
+	if (capture_buffer) {
+		if (capture_buffer->size() + data.size() > capture_limit) {
+			capture_buffer->clear();
+			capture_buffer = nullptr;
+		} else {
+			capture_buffer->append(data);
+		}
+	}
+	stream->write(data);
+	bytes += data.size();
+	chunks++;
+}
+
+void ResponseWriter::writeBuffer() {
+	writeBlock(std::string_view(pbase(), pptr() - pbase()));
+	setp(buffer.get(), buffer.get()+chunk_size);
+}
+
+void ResponseWriter::append(const std::string_view &data) {
+	std::size_t space = epptr() - pptr();
+	if (data.size() <= space) {
+		std::copy(data.begin(), data.end(), pptr());
+		pbump(static_cast<int>(data.size()));
+	} else if (pptr() == pbase() && data.size() >= chunk_size) {
+		//large block while the buffer is empty, no need to copy it
+		writeBlock(data);
+	} else {
+		std::copy(data.begin(), data.begin()+space, pptr());
+		pbump(static_cast<int>(space));
+		writeBuffer();
+		append(data.substr(space));
+	}
+}
+
+void ResponseWriter::serialize(const json::Value &v) {
+	v.serialize([&](char c){put(c);});
+}
+
+void ResponseWriter::capture(std::string &buffer, std::size_t limit) {
+	capture_buffer = &buffer;
+	capture_limit = limit;
+	capture_buffer->clear();
+}
+
+void ResponseWriter::finish() {
+	if (finished) return;
+	finished = true;
+	finishing = true;
+	writeBuffer();
+	if (!stream) start(0);
+	if (deflate) compress(std::string_view(), true);
+	stream->flush();
+	stats.record(bytes, chunks);
+}
+
+ResponseWriter::int_type ResponseWriter::overflow(int_type c) {
+	writeBuffer();
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		put(traits_type::to_char_type(c));
+	}
+	return traits_type::not_eof(c);
+}
+
+std::streamsize ResponseWriter::xsputn(const char *s, std::streamsize n) {
+	append(std::string_view(s, n));
+	return n;
+}
+
+int ResponseWriter::sync() {
+	return 0;
+}
+
+ContentEncoding ResponseWriter::negotiate(std::string_view accept_encoding) {
+	//explicitly named codings take precedence over the wildcard
+	bool gzip = false, gzip_named = false;
+	bool deflate = false, deflate_named = false;
+	bool any = false;
+	while (!accept_encoding.empty()) {
+		auto sep = accept_encoding.find(',');
+		auto item = accept_encoding.substr(0, sep);
+		accept_encoding = sep == accept_encoding.npos?std::string_view():accept_encoding.substr(sep+1);
+		//coding;q=value, q=0 means not acceptable
+		auto params = item.find(';');
+		auto name = item.substr(0, params);
+		bool acceptable = true;
+		if (params != item.npos) {
+			auto q = item.substr(params+1);
+			auto qpos = q.find("q=");
+			if (qpos != q.npos) {
+				std::string qval(q.substr(qpos+2));
+				acceptable = std::strtod(qval.c_str(), nullptr) > 0;
+			}
+		}
+		while (!name.empty() && std::isspace(static_cast<unsigned char>(name.front()))) name = name.substr(1);
+		while (!name.empty() && std::isspace(static_cast<unsigned char>(name.back()))) name = name.substr(0, name.size()-1);
+		if (name == "gzip" || name == "x-gzip") {
+			gzip = gzip || acceptable;
+			gzip_named = true;
+		} else if (name == "deflate") {
+			deflate = deflate || acceptable;
+			deflate_named = true;
+		} else if (name == "*") {
+			any = any || acceptable;
+		}
+	}
+	if (!gzip_named) gzip = any;
+	if (!deflate_named) deflate = any;
+	if (gzip) return ContentEncoding::gzip;
+	if (deflate) return ContentEncoding::deflate;
+	return ContentEncoding::identity;
+}
+
+std::string_view ResponseWriter::encodingName(ContentEncoding encoding) {
+	switch (encoding) {
+		case ContentEncoding::gzip: return "gzip";
+		case ContentEncoding::deflate: return "deflate";
+		default: return "identity";
+	}
+}
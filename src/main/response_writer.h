@@ -0,0 +1,150 @@
+/*
+ * response_writer.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_RESPONSE_WRITER_H_
+#define SRC_MAIN_RESPONSE_WRITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#include <imtjson/value.h>
+#include <userver/http_server.h>
+
+///Statistics of the responses generated through the ResponseWriter
+struct ResponseStats {
+	std::atomic<std::uint64_t> responses{0};
+	std::atomic<std::uint64_t> bytes{0};
+	std::atomic<std::uint64_t> chunks{0};
+	std::atomic<std::uint64_t> largest{0};
+
+	///Records finished response
+	void record(std::uint64_t bytes, std::uint64_t chunks);
+	json::Value toJSON() const;
+};
+
+///Content coding of the response
+enum class ContentEncoding {
+	identity,
+	gzip,
+	deflate
+};
+
+///Settings of the response compression
+struct CompressionConfig {
+	///zlib compression level (1-9), 0 - compression is disabled
+	int level = 6;
+	///smaller responses are sent uncompressed. Value is limited by the size of the block
+	std::size_t min_size = 1024;
+};
+
+///Writes response body to the stream in large blocks
+/**
+ * Data are collected in the buffer and the stream receives whole blocks only.
+ * The object is also a std::streambuf, so it can be used with std::ostream
+ *
+ * The body can be compressed on the fly, only one block of the compressed data
+ * is held in the memory
+ */
+class ResponseWriter: public std::streambuf {
+public:
+	///size of the block
+	static constexpr std::size_t chunk_size = 64*1024;
+
+	///Construct writer
+	/**
+	 * @param stream stream of the response (see HttpServerRequest::send)
+	 * @param stats statistics, which are updated when response is finished
+	 */
+	ResponseWriter(userver::Stream &&stream, ResponseStats &stats);
+	///Construct writer, which compresses the body
+	/**
+	 * The response is started when the first block is written, so the headers can
+	 * be set until then. The writer sets the header Content-Encoding
+	 *
+	 * @param req request
+	 * @param stats statistics, which are updated when response is finished
+	 * @param encoding content coding. When the whole body is smaller than
+	 * the min_size, it is sent uncompressed
+	 * @param cfg compression settings
+	 */
+	ResponseWriter(userver::HttpServerRequest &req, ResponseStats &stats, ContentEncoding encoding, const CompressionConfig &cfg);
+	///Finishes response if not finished yet
+	/**
+	 * When the writer is destroyed during stack unwinding, the response is not
+	 * finished, so an error of the rendering doesn't produce a complete response.
+	 * If the response was not started, the request stays unsent
+	 */
+	~ResponseWriter();
+
+	ResponseWriter(const ResponseWriter &) = delete;
+	ResponseWriter &operator=(const ResponseWriter &) = delete;
+
+	void append(const std::string_view &data);
+	void put(char c) {
+		if (pptr() == epptr()) writeBuffer();
+		*pptr() = c;
+		pbump(1);
+	}
+	///Writes JSON value
+	void serialize(const json::Value &v);
+	///Collects copy of the body to the buffer
+	/**
+	 * @param buffer buffer, which receives the body
+	 * @param limit maximal size of the body. When the body is larger, the buffer is
+	 * cleared and collecting is stopped
+	 */
+	void capture(std::string &buffer, std::size_t limit);
+	///Returns true, when the buffer contains whole body (see capture)
+	bool captured() const {return capture_buffer != nullptr;}
+	///Sends pending data and flushes the stream. Updates statistics
+	void finish();
+	///Returns content coding of the sent body (valid after the response is started)
+	ContentEncoding getEncoding() const {return encoding;}
+
+	///Chooses content coding from the Accept-Encoding header, gzip is preferred
+	static ContentEncoding negotiate(std::string_view accept_encoding);
+	///Returns name of the coding (value of the header Content-Encoding)
+	static std::string_view encodingName(ContentEncoding encoding);
+
+protected:
+	struct Deflate;
+
+	userver::HttpServerRequest *req = nullptr;
+	//stream is opened with the first block
+	std::optional<userver::Stream> stream;
+	ResponseStats &stats;
+	ContentEncoding encoding = ContentEncoding::identity;
+	CompressionConfig cfg;
+	std::unique_ptr<Deflate> deflate;
+	std::unique_ptr<char[]> buffer;
+	std::uint64_t bytes = 0;
+	std::uint64_t chunks = 0;
+	bool finished = false;
+	bool finishing = false;
+	//count of uncaught exceptions, when the writer was constructed
+	int uncaught;
+	std::string *capture_buffer = nullptr;
+	std::size_t capture_limit = 0;
+
+	void writeBuffer();
+	void writeBlock(const std::string_view &data);
+	///Opens the stream, decides whether to compress the body
+	void start(std::size_t size);
+	void compress(const std::string_view &data, bool last);
+	void sendBlock(const std::string_view &data);
+
+	virtual int_type overflow(int_type c) override;
+	virtual std::streamsize xsputn(const char *s, std::streamsize n) override;
+	virtual int sync() override;
+};
+
+#endif /* SRC_MAIN_RESPONSE_WRITER_H_ */
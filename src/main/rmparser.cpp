@@ -8,11 +8,16 @@
 
 #include "rmparser.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
+#include <limits>
 #include <queue>
+#include <sstream>
 
 #include <imtjson/object.h>
+#include "point_kernels.h"
+#include "worker_pool.h"
 json::NamedEnum<Drawing::Color> Drawing::strColor({
 	{Color::black, "black"},
 	{Color::white, "white"},
@@ -45,65 +50,157 @@ void swap32(void *what) {
 }
 
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+
 void Drawing::Content::read(std::istream &in) {
-	char buff[33];
-	in.read(buff, sizeof(buff));
-	if (!in || in.gcount() != sizeof(buff)) throw std::runtime_error("Header truncated");
-	std::string_view hdrver(buff,sizeof(buff));
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	read(data);
+}
+
+std::size_t Drawing::readHeader(const std::string_view &data, Stream &stream) {
+	static constexpr std::size_t hdr_size = 33;
+	static constexpr std::size_t hdr5_pad = 10;
+
+	if (data.size() < hdr_size) throw std::runtime_error("Header truncated");
+	std::string_view hdrver = data.substr(0, hdr_size);
 
+	int version;
 	if (hdrver == "reMarkable .lines file, version=3") version = 3;
 	else if (hdrver == "reMarkable .lines file, version=5") version = 5;
 	else throw std::runtime_error("Unsupported file version");
 
+	stream = Stream {
+			version, false, data.data()+hdr_size, data.data()+data.size()
+	};
+
 	if (version == 5) {
-		char buff[10];
-		in.read(buff, sizeof(buff));
-		if (!in || in.gcount() != sizeof(buff)) throw std::runtime_error("Header truncated (version 5)");
-		for (char c: buff) {
-			if (c != 32) throw std::runtime_error("Unknown data in header");
+		if (static_cast<std::size_t>(stream.end - stream.pos) < hdr5_pad) throw std::runtime_error("Header truncated (version 5)");
+		const char *pad = stream.take(hdr5_pad);
+		for (std::size_t i = 0; i < hdr5_pad; i++) {
+			if (pad[i] != 32) throw std::runtime_error("Unknown data in header");
 		}
 	}
 
-	uint32_t layersCount;
-	bool swap_bytes = false;
-	in.read(reinterpret_cast<char *>(&layersCount),sizeof(layersCount));
-	if (!in || in.gcount() != sizeof (layersCount))  throw std::runtime_error("File truncated (can't read layers)");
+	if (stream.end - stream.pos < 4) throw std::runtime_error("File truncated (can't read layers)");
+	uint32_t layersCount = static_cast<uint32_t>(readInt32(stream));
 	if (layersCount > 16) {
 		swap32(&layersCount);
 		if (layersCount > 16) throw std::runtime_error("Invalid count of layers");
-		swap_bytes = true;
+		stream.swap_endian = true;
 	}
+	return layersCount;
+}
 
+void Drawing::Content::read(const std::string_view &data) {
+	Stream stream;
+	std::size_t layersCount = readHeader(data, stream);
+	version = stream.version;
 
-	Stream stream {
-			version, swap_bytes, in
-	};
+	//first pass validates the structure and counts points, so the arena is allocated once
+	Stream scan = stream;
+	arena.reset(skipLayers(scan, layersCount) * Points::column_count);
+
+	layers.resize(layersCount);
+	for (Layer &lr: layers) {
+		lr.read(stream, arena);
+	}
+
+}
+
+void Drawing::Content::visit(Visitor &visitor) const {
+	visitor.begin_content(version, layers.size());
+	for (std::size_t i = 0; i < layers.size(); i++) {
+		const Layer &lr = layers[i];
+		do {
+			visitor.begin_layer(i, lr.lines.size());
+			for (const Line &ln: lr.lines) {
+				visitor.begin_line(ln);
+				visitor.points(ln.points);
+				visitor.end_line(ln);
+			}
+		} while (visitor.end_layer(i));
+	}
+	visitor.end_content();
+}
+
+void Drawing::parse_rm(const std::string_view &data, Visitor &visitor) {
+	Stream stream;
+	std::size_t layersCount = readHeader(data, stream);
+	visitor.begin_content(stream.version, layersCount);
+	//line is reused, so points buffer is allocated only for the longest line
+	Line ln;
+	for (std::size_t i = 0; i < layersCount; i++) {
+		const char *layer_start = stream.pos;
+		do {
+			stream.pos = layer_start;
+			std::size_t lines = readCount(stream);
+			visitor.begin_layer(i, lines);
+			for (std::size_t j = 0; j < lines; j++) {
+				ln.readHeader(stream);
+				ln.points.truncate(0);
+				visitor.begin_line(ln);
+				readArray(ln.points, stream);
+				visitor.points(ln.points);
+				visitor.end_line(ln);
+			}
+		} while (visitor.end_layer(i));
+	}
+	visitor.end_content();
+}
 
-	layers.clear();
-	layers.reserve(layersCount);
+void Drawing::check_rm(const std::string_view &data) {
+	Stream stream;
+	std::size_t layersCount = readHeader(data, stream);
+	skipLayers(stream, layersCount);
+}
 
-	for (uint32_t i = 0; i < layersCount; i++) {
-		Layer lr;
-		lr.read(stream);
-		layers.push_back(std::move(lr));
+std::size_t Drawing::skipLayers(Stream &stream, std::size_t layers) {
+	std::size_t total = 0;
+	Line ln;
+	for (std::size_t i = 0; i < layers; i++) {
+		std::size_t lines = readCount(stream);
+		for (std::size_t j = 0; j < lines; j++) {
+			ln.readHeader(stream);
+			std::size_t entries;
+			readPointsBlock(stream, entries);
+			total += entries;
+		}
 	}
+	return total;
+}
 
+const char *Drawing::Stream::take(std::size_t bytes) {
+	if (static_cast<std::size_t>(end - pos) < bytes) throw std::runtime_error("Read error");
+	const char *p = pos;
+	pos += bytes;
+	return p;
 }
 
-void Drawing::Layer::read(const Stream &stream) {
-	readArray(lines,  stream);
+void Drawing::Layer::read(Stream &stream, PointArena &arena) {
+	std::size_t entries = readCount(stream);
+	if (entries > static_cast<std::size_t>(stream.end - stream.pos)) throw std::runtime_error("Read error");
+	//existing lines are reused
+	lines.resize(entries);
+	for (Line &ln: lines) {
+		ln.readHeader(stream);
+		readArray(ln.points, stream, arena);
+	}
 }
 
-int Drawing::readInt32(const Stream &stream) {
+int Drawing::decodeInt32(const char *data, bool swap_endian) {
 	int32_t x;
-	stream.stream.read(reinterpret_cast<char *>(&x), sizeof(x));
-	if (!stream.stream || stream.stream.gcount() != sizeof(x)) throw std::runtime_error("Read error");
-	if (stream.swap_endian) {
+	std::memcpy(&x, data, sizeof(x));
+	if (swap_endian) {
 		swap32(&x);
 	}
 	return x;
 }
 
+int Drawing::readInt32(Stream &stream) {
+	return decodeInt32(stream.take(sizeof(int32_t)), stream.swap_endian);
+}
+
 json::Value Drawing::toJSON() const {
 	using namespace json;
 
@@ -134,52 +231,119 @@ union ReadIntAsFLoat {
 	float fval;
 };
 
-float Drawing::readFloat32(const Stream &stream) {
+float Drawing::decodeFloat32(const char *data, bool swap_endian) {
 	ReadIntAsFLoat n;
-	n.ival = readInt32(stream);
+	n.ival = decodeInt32(data, swap_endian);
 	return n.fval;
 }
 
-template<typename T>
-void Drawing::readArray(std::vector<T> &cont, const Stream &stream) {
+float Drawing::readFloat32(Stream &stream) {
+	return decodeFloat32(stream.take(sizeof(float)), stream.swap_endian);
+}
+
+std::size_t Drawing::readCount(Stream &stream) {
 	int entries = readInt32(stream);
 	if (entries<0) throw std::runtime_error("Format error (invalid container size)");
-	cont.clear();
-	if (entries) {
-		cont.reserve(entries);
-		for (int i = 0; i < entries; i++) {
-			T item;
-			item.read(stream);
-			cont.push_back(std::move(item));
-		}
-	}
+	return static_cast<std::size_t>(entries);
 }
 
+const char *Drawing::readPointsBlock(Stream &stream, std::size_t &entries) {
+	entries = readCount(stream);
+	if (entries > static_cast<std::size_t>(stream.end - stream.pos) / Point::binary_size)
+		throw std::runtime_error("Read error");
+	return stream.take(entries * Point::binary_size);
+}
+
+void Drawing::readArray(Points &cont, Stream &stream) {
+	std::size_t entries;
+	const char *data = readPointsBlock(stream, entries);
+	cont.resize(entries);
+	decodePoints(cont, data, stream.swap_endian);
+}
+
+void Drawing::readArray(Points &cont, Stream &stream, PointArena &arena) {
+	std::size_t entries;
+	const char *data = readPointsBlock(stream, entries);
+	cont.assign(arena.alloc(entries * Points::column_count), entries);
+	decodePoints(cont, data, stream.swap_endian);
+}
+
+void Drawing::decodePoints(Points &cont, const char *data, bool swap_endian) {
+	float * const cols[Points::column_count] = {
+			cont.column(Points::col_x),
+			cont.column(Points::col_y),
+			cont.column(Points::col_speed),
+			cont.column(Points::col_direction),
+			cont.column(Points::col_width),
+			cont.column(Points::col_pressure)
+	};
+	point_kernels::decodePoints(data, cont.size(), swap_endian, cols);
+}
 
-void Drawing::Line::read(const Stream &stream) {
-	type = readBrush(stream);
-	color = readColor(stream);
-	reserved1 = readInt32(stream);
-	size = readFloat32(stream);
+
+void Drawing::Line::readHeader(Stream &stream) {
+	const bool swp = stream.swap_endian;
+	const char *hdr = stream.take(stream.version >= 5?20:16);
+	type = decodeBrush(decodeInt32(hdr, swp));
+	color = decodeColor(decodeInt32(hdr+4, swp));
+	reserved1 = decodeInt32(hdr+8, swp);
+	size = decodeFloat32(hdr+12, swp);
 	if (stream.version >= 5) {
-		reserved2 = readInt32(stream);
+		reserved2 = decodeInt32(hdr+16, swp);
 	} else {
 		reserved2 = 0;
 	}
-	readArray(points, stream);
 }
 
-void Drawing::Point::read(const Stream &stream) {
-	x = readFloat32(stream);
-	y = readFloat32(stream);
-	speed = readFloat32(stream);
-	direction = readFloat32(stream);
-	width = readFloat32(stream);
-	pressure = readFloat32(stream);
+void Drawing::Points::resize(std::size_t count) {
+	this->ext = nullptr;
+	this->count = count;
+	this->stride = count;
+	data.resize(count * column_count);
+}
+
+void Drawing::Points::assign(float *buffer, std::size_t count) {
+	this->ext = buffer;
+	this->count = count;
+	this->stride = count;
 }
 
-Drawing::Color Drawing::readColor(const Stream &stream) {
-	int c = readInt32(stream);
+void Drawing::PointArena::reset(std::size_t floats) {
+	used = 0;
+	if (floats > capacity) {
+		buffer.reset();
+		buffer.reset(new float[floats]);
+		capacity = floats;
+	}
+}
+
+float *Drawing::PointArena::alloc(std::size_t floats) {
+	if (floats > capacity - used) throw std::runtime_error("PointArena: out of space");
+	float *p = buffer.get()+used;
+	used += floats;
+	return p;
+}
+
+void Drawing::Points::truncate(std::size_t count) {
+	if (count < this->count) this->count = count;
+}
+
+Drawing::Point Drawing::Points::operator[](std::size_t idx) const {
+	return Point {
+		x()[idx], y()[idx], speed()[idx], direction()[idx], width()[idx], pressure()[idx]
+	};
+}
+
+void Drawing::Points::set(std::size_t idx, const Point &pt) {
+	column(col_x)[idx] = pt.x;
+	column(col_y)[idx] = pt.y;
+	column(col_speed)[idx] = pt.speed;
+	column(col_direction)[idx] = pt.direction;
+	column(col_width)[idx] = pt.width;
+	column(col_pressure)[idx] = pt.pressure;
+}
+
+Drawing::Color Drawing::decodeColor(int c) {
 	switch (c) {
 	case 0: return Color::black;
 	case 1: return Color::gray;
@@ -190,10 +354,69 @@ Drawing::Color Drawing::readColor(const Stream &stream) {
 
 void Drawing::load_rm(std::istream &in) {
 	content.read(in);
+	index_valid = false;
+}
+
+void Drawing::load_rm(const std::string_view &data) {
+	content.read(data);
+	index_valid = false;
 }
 
-Drawing::Brush Drawing::readBrush(const Stream &stream) {
-	int c = readInt32(stream);
+void Drawing::LineIndex::build(const Content &content) {
+	bounds.resize(content.layers.size());
+	cells.resize(cols*rows);
+	for (auto &c: cells) c.clear();
+	for (std::uint32_t l = 0, lcnt = static_cast<std::uint32_t>(content.layers.size()); l < lcnt; l++) {
+		const auto &lines = content.layers[l].lines;
+		auto &lb = bounds[l];
+		lb.resize(lines.size());
+		for (std::uint32_t i = 0, cnt = static_cast<std::uint32_t>(lines.size()); i < cnt; i++) {
+			lb[i] = lines[i].getBounds();
+			int c1,r1,c2,r2;
+			if (cellRange(lb[i], c1, r1, c2, r2)) {
+				for (int r = r1; r <= r2; r++) {
+					for (int c = c1; c <= c2; c++) cells[r*cols+c].push_back({l,i});
+				}
+			}
+		}
+	}
+}
+
+void Drawing::LineIndex::find(const Box &box, std::vector<Entry> &result) const {
+	result.clear();
+	int c1,r1,c2,r2;
+	if (!cellRange(box, c1, r1, c2, r2)) return;
+	for (int r = r1; r <= r2; r++) {
+		for (int c = c1; c <= c2; c++) {
+			for (const Entry &e: cells[r*cols+c]) {
+				if (getBounds(e).intersects(box)) result.push_back(e);
+			}
+		}
+	}
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+const Drawing::LineIndex &Drawing::getIndex() {
+	if (!index_valid) {
+		index.build(content);
+		index_valid = true;
+	}
+	return index;
+}
+
+void Drawing::clip(const Box &box) {
+	//single query, building the index would cost more than the bounds of all lines
+	for (auto &layer: content.layers) {
+		auto &lines = layer.lines;
+		lines.erase(std::remove_if(lines.begin(), lines.end(), [&](const Line &ln){
+			return !ln.getBounds().intersects(box);
+		}), lines.end());
+	}
+	index_valid = false;
+}
+
+Drawing::Brush Drawing::decodeBrush(int c) {
 	switch (c) {
 	case 0:return Brush::Brush;
 	case 1: return Brush::TiltPencil;
@@ -274,9 +497,134 @@ static std::string putMaskAttr(int maskId) {
 	}
 }
 
-void Drawing::highlighter_to_svg(const Line &ln, const std::string &color, int maskId, std::ostream &out) {
+//Writes path data (content of the attribute d)
+class PathWriter {
+public:
+	PathWriter(const Drawing::SvgOptions &opts, std::ostream &out);
+	void moveTo(float x, float y);
+	void lineTo(float x, float y);
+	void close();
+	///Finishes the path started by moveTo
+	void finish();
+protected:
+	std::ostream &out;
+	bool compact;
+	NumFormat num;
+	float grid;
+	//last point in grid units (compact mode)
+	long long qx = 0, qy = 0;
+	//compact mode - a segment has been written
+	bool segment = false;
+	//compact mode - a segment has been skipped
+	bool skipped = false;
+	char buff[2*NumFormat::max_length+4];
+
+	//max coordinate in grid units, differences of the coordinates can't overflow
+	static constexpr float max_units = 1e15f;
+
+	char *writeCoord(char *p, long long v, bool sep) const;
+	///Converts coordinate to grid units
+	long long quantize(float v) const;
+};
+
+PathWriter::PathWriter(const Drawing::SvgOptions &opts, std::ostream &out)
+	:out(out),compact(opts.compact),num(opts.num),grid(opts.grid > 0?opts.grid:Drawing::svg_grid) {
+	if (compact) {
+		//count of decimal places needed to write multiples of the grid
+		int d = 0;
+		for (float g = grid; d < NumFormat::max_decimals && std::abs(g - std::round(g)) > 1e-3f; g *= 10) d++;
+		num = NumFormat(d);
+	}
+}
+
+long long PathWriter::quantize(float v) const {
+	//clamped before conversion, a corrupt file can contain huge or NaN coordinates
+	float q = std::clamp(v / grid, -max_units, max_units);
+	return q == q?std::llround(q):0;
+}
+
+char *PathWriter::writeCoord(char *p, long long v, bool sep) const {
+	//separator is not needed before negative number
+	if (sep && v >= 0) *p++ = ' ';
+	return num.format(v * grid, p);
+}
+
+void PathWriter::moveTo(float x, float y) {
+	char *p = buff;
+	if (compact) {
+		qx = quantize(x);
+		qy = quantize(y);
+		segment = false;
+		skipped = false;
+		*p++ = 'M';
+		p = writeCoord(p, qx, false);
+		p = writeCoord(p, qy, true);
+	} else {
+		*p++ = 'M'; *p++ = ' ';
+		p = num.format(x, p);
+		*p++ = ' ';
+		p = num.format(y, p);
+	}
+	out.write(buff, p - buff);
+}
+
+void PathWriter::lineTo(float x, float y) {
+	char *p = buff;
+	if (compact) {
+		long long nx = quantize(x);
+		long long ny = quantize(y);
+		long long dx = nx - qx;
+		long long dy = ny - qy;
+		if (dx == 0 && dy == 0) {
+			skipped = true;
+			return;
+		}
+		qx = nx;
+		qy = ny;
+		//command is repeated implicitly
+		if (!segment) *p++ = 'l';
+		p = writeCoord(p, dx, segment);
+		p = writeCoord(p, dy, true);
+		segment = true;
+	} else {
+		*p++ = ' '; *p++ = 'L'; *p++ = ' ';
+		p = num.format(x, p);
+		*p++ = ' ';
+		p = num.format(y, p);
+	}
+	out.write(buff, p - buff);
+}
+
+void PathWriter::close() {
+	finish();
+	if (compact) out.put('z');
+	else out << " Z";
+}
+
+void PathWriter::finish() {
+	//zero length segment must be kept, it renders the dot
+	if (compact && skipped && !segment) {
+		out << "l0 0";
+		segment = true;
+	}
+}
+
+void Drawing::path_to_svg(const Points &pts, bool close, const SvgOptions &opts, std::ostream &out) {
+	if (pts.empty()) return;
+	const float *x = pts.x();
+	const float *y = pts.y();
+	PathWriter wr(opts, out);
+	wr.moveTo(x[0], y[0]);
+	for (std::size_t i = 0, cnt = pts.size(); i < cnt; i++) {
+		wr.lineTo(x[i], y[i]);
+	}
+	if (close) wr.close();
+	else wr.finish();
+}
+
+void Drawing::highlighter_to_svg(const Line &ln, const std::string &color, int maskId, const SvgOptions &opts, std::ostream &out) {
 	if (ln.points.empty()) return;
-	const auto &first_point = ln.points[0];
+	const Point first_point = ln.points.front();
 
 	out << "<path fill=\"none\" "
 		         "stroke-linecap=\"butt\" "
@@ -285,11 +633,9 @@ void Drawing::highlighter_to_svg(const Line &ln, const std::string &color, int m
 		         "class=\"Highlighter\" "
   				  << putMaskAttr(maskId) <<
 		         "stroke=\""<< color <<"\" "
-		         "stroke-width=\"" << first_point.width << "\" "
-		         "d=\"M " << first_point.x << " " << first_point.y;
-	for (const auto &pt: ln.points) {
-		out << " L " << pt.x << " " << pt.y;
-	}
+		         "stroke-width=\"" << opts.num(first_point.width) << "\" "
+		         "d=\"";
+	path_to_svg(ln.points, false, opts, out);
 	out << "\" />";
 }
 
@@ -298,26 +644,24 @@ const Drawing::Content& Drawing::getContent() const {
 }
 
 
-void Drawing::fineliner_to_svg(const Line &ln, const std::string &color, int maskId, std::ostream &out) {
+void Drawing::fineliner_to_svg(const Line &ln, const std::string &color, int maskId, const SvgOptions &opts, std::ostream &out) {
 	if (ln.points.empty()) return;
-	const auto &first_point = ln.points[0];
+	const Point first_point = ln.points.front();
 
 	out << "<path fill=\"none\" "
 		         "stroke-linecap=\"round\" "
 		         "class=\"Highlighter\" "
 				 << putMaskAttr(maskId) <<
 		         "stroke=\""<< color <<"\" "
-		         "stroke-width=\"" << (first_point.width*width_factor) << "\" "
-		         "d=\"M " << first_point.x << " " << first_point.y;
-	for (const auto &pt: ln.points) {
-		out << " L " << pt.x << " " << pt.y;
-	}
+		         "stroke-width=\"" << opts.num(first_point.width*width_factor) << "\" "
+		         "d=\"";
+	path_to_svg(ln.points, false, opts, out);
 	out << "\" />";
 }
 
-void Drawing::define_eraser_mask(const Line &ln, int id, std::ostream &out) {
+void Drawing::define_eraser_mask(const Line &ln, int id, const SvgOptions &opts, std::ostream &out) {
 	if (ln.points.empty()) return;
-	const auto &first_point = ln.points[0];
+	const Point first_point = ln.points.front();
 
 	out << "<path id=\"eraser_" << id<< "\" "
 			     "fill=\"none\" "
@@ -325,47 +669,221 @@ void Drawing::define_eraser_mask(const Line &ln, int id, std::ostream &out) {
 			  	  "stroke-linejoin=\"bevel\" "
 		         "class=\"Eraser\" "
 		         "stroke=\"black\" "
-		         "stroke-width=\"" << (first_point.width) << "\" "
-		         "d=\"M " << first_point.x << " " << first_point.y;
-	for (const auto &pt: ln.points) {
-		out << " L " << pt.x << " " << pt.y;
-	}
+		         "stroke-width=\"" << opts.num(first_point.width) << "\" "
+		         "d=\"";
+	path_to_svg(ln.points, false, opts, out);
 	out << "\" />";
 
 }
 
-void Drawing::define_eraseArea_mask(const Line &ln, int id, std::ostream &out) {
+void Drawing::define_eraseArea_mask(const Line &ln, int id, const SvgOptions &opts, std::ostream &out) {
 	if (ln.points.empty()) return;
-	const auto &first_point = ln.points[0];
+	const Point first_point = ln.points.front();
 
 	out << "<path id=\"eraser_" << id<< "\" "
 			     "fill=\"black\" "
 				  "stroke-linecap=\"round\" "
 			      "stroke-linejoin=\"bevel\" "
-				 "stroke-width=\"" << (first_point.width) << "\" "
+				 "stroke-width=\"" << opts.num(first_point.width) << "\" "
 		         "class=\"Eraser\" "
 		         "stroke=\"black\" "
-		         "d=\"M " << first_point.x << " " << first_point.y;
-	for (const auto &pt: ln.points) {
-		out << " L " << pt.x << " " << pt.y;
-	}
-	out << " Z";
+		         "d=\"";
+	path_to_svg(ln.points, true, opts, out);
 	out << "\" />";
 
 }
 
-template<typename Cont>
-void combineMasks(const Cont &mask_map, std::ostream &out) {
-	for (const auto &m: mask_map) {
-		out << "<use href=\"#eraser_" << m.second << "\" />";
+static void combineMasks(const std::vector<int> &masks, std::ostream &out) {
+	for (int id: masks) {
+		out << "<use href=\"#eraser_" << id << "\" />";
+	}
+
+}
+
+void Drawing::EraserIndex::clear() {
+	erasers.clear();
+	cells.clear();
+}
+
+void Drawing::EraserIndex::add(std::size_t index, int id, const Box &box) {
+	erasers.push_back({index, id, box});
+	std::size_t cnt = erasers.size();
+	if (cnt == index_threshold) {
+		build();
+	} else if (cnt > index_threshold) {
+		int c1,r1,c2,r2;
+		if (cellRange(box, c1, r1, c2, r2)) {
+			for (int r = r1; r <= r2; r++) {
+				for (int c = c1; c <= c2; c++) cells[r*cols+c].push_back(static_cast<std::uint32_t>(cnt-1));
+			}
+		}
+	}
+}
+
+bool Drawing::PageGrid::cellRange(const Box &box, int &c1, int &r1, int &c2, int &r2) {
+	if (!box.valid()) return false;
+	//coordinates outside of the page are mapped to the border cells, clamped before
+	//conversion, because infinite or huge values can't be converted to int
+	auto cell = [](float v, int count) {
+		return static_cast<int>(std::clamp(std::floor(v / cell_size), 0.0f, static_cast<float>(count-1)));
+	};
+	c1 = cell(box.left, cols);
+	c2 = cell(box.right, cols);
+	r1 = cell(box.top, rows);
+	r2 = cell(box.bottom, rows);
+	return true;
+}
+
+void Drawing::EraserIndex::build() {
+	cells.resize(cols*rows);
+	for (auto &c: cells) c.clear();
+	for (std::size_t i = 0, cnt = erasers.size(); i < cnt; i++) {
+		int c1,r1,c2,r2;
+		if (cellRange(erasers[i].box, c1, r1, c2, r2)) {
+			for (int r = r1; r <= r2; r++) {
+				for (int c = c1; c <= c2; c++) cells[r*cols+c].push_back(static_cast<std::uint32_t>(i));
+			}
+		}
+	}
+}
+
+void Drawing::EraserIndex::find(std::size_t first, const Box &box, std::vector<int> &ids) const {
+	ids.clear();
+	std::size_t cnt = erasers.size();
+	if (first >= cnt) return;
+	if (cnt < index_threshold) {
+		for (std::size_t i = first; i < cnt; i++) {
+			if (erasers[i].box.intersects(box)) ids.push_back(erasers[i].id);
+		}
+		return;
+	}
+	int c1,r1,c2,r2;
+	if (!cellRange(box, c1, r1, c2, r2)) return;
+	found.clear();
+	for (int r = r1; r <= r2; r++) {
+		for (int c = c1; c <= c2; c++) {
+			const auto &cell = cells[r*cols+c];
+			//positions in the cell are ordered
+			auto iter = std::lower_bound(cell.begin(), cell.end(), static_cast<std::uint32_t>(first));
+			for (; iter != cell.end(); ++iter) {
+				if (erasers[*iter].box.intersects(box)) found.push_back(*iter);
+			}
+		}
+	}
+	std::sort(found.begin(), found.end());
+	found.erase(std::unique(found.begin(), found.end()), found.end());
+	for (std::uint32_t pos: found) ids.push_back(erasers[pos].id);
+}
+
+bool Drawing::EraserIndex::any(std::size_t first, const Box &box) const {
+	std::size_t cnt = erasers.size();
+	if (first >= cnt) return false;
+	if (cnt < index_threshold) {
+		for (std::size_t i = first; i < cnt; i++) {
+			if (erasers[i].box.intersects(box)) return true;
+		}
+		return false;
+	}
+	int c1,r1,c2,r2;
+	if (!cellRange(box, c1, r1, c2, r2)) return false;
+	for (int r = r1; r <= r2; r++) {
+		for (int c = c1; c <= c2; c++) {
+			const auto &cell = cells[r*cols+c];
+			auto iter = std::lower_bound(cell.begin(), cell.end(), static_cast<std::uint32_t>(first));
+			for (; iter != cell.end(); ++iter) {
+				if (erasers[*iter].box.intersects(box)) return true;
+			}
+		}
+	}
+	return false;
+}
+
+void Drawing::render_svg(std::ostream &out, const ColorDef &def, const SvgOptions &opts, WorkerPool *pool) const {
+	//count of points rendered by single task
+	static constexpr std::size_t chunk_points = 8192;
+
+	SvgRenderer renderer(out, def, opts);
+	std::size_t total = 0;
+	for (const Layer &lr: content.layers) {
+		for (const Line &ln: lr.lines) total += ln.points.size();
+	}
+	if (pool == nullptr || pool->getThreads() < 2 || total < 2*chunk_points) {
+		content.visit(renderer);
+		return;
 	}
 
+	//Layer is split to a task which defines masks and tasks which render chunks of lines.
+	//The state of the renderer at the beginning of each task is calculated without
+	//rendering, so ids are same as in serial rendering
+	struct Task {
+		const Layer &layer;
+		std::size_t begin, end;
+		bool defs;
+		bool last;
+		SvgRenderer state;
+		std::string output;
+	};
+	std::vector<Task> tasks;
+
+	renderer.begin_content(content.version, content.layers.size());
+	for (const Layer &lr: content.layers) {
+		std::size_t cnt = lr.lines.size();
+		tasks.push_back({lr, 0, cnt, true, false, renderer, std::string()});
+		renderer.begin_pass(false);
+		for (const Line &ln: lr.lines) renderer.defineLine(ln, false);
+		renderer.end_pass(false);
+		renderer.begin_pass(false);
+		std::size_t pos = 0;
+		do {
+			tasks.push_back({lr, pos, pos, false, false, renderer, std::string()});
+			std::size_t pts = 0;
+			while (pos < cnt && pts < chunk_points) {
+				const Line &ln = lr.lines[pos++];
+				pts += ln.points.size();
+				renderer.renderLine(ln, false);
+			}
+			tasks.back().end = pos;
+		} while (pos < cnt);
+		tasks.back().last = true;
+		renderer.end_pass(false);
+	}
+
+	pool->parallel_for(tasks.size(), [&](std::size_t idx) {
+		Task &t = tasks[idx];
+		std::ostringstream buff;
+		SvgRenderer r(buff, t.state);
+		if (t.defs) {
+			r.begin_pass(true);
+			for (std::size_t i = t.begin; i < t.end; i++) r.defineLine(t.layer.lines[i], true);
+			r.end_pass(true);
+		} else {
+			for (std::size_t i = t.begin; i < t.end; i++) r.renderLine(t.layer.lines[i], true);
+			if (t.last) r.end_pass(true);
+		}
+		t.output = buff.str();
+	});
+
+	for (const Task &t: tasks) out.write(t.output.data(), t.output.size());
+	renderer.end_content();
 }
 
-void Drawing::render_svg(std::ostream &out, const ColorDef &def) const {
+void Drawing::write_json(std::ostream &out, const NumFormat &num, bool columnar) const {
+	JsonWriter writer(out, num, columnar);
+	content.visit(writer);
+}
+
+Drawing::SvgRenderer::SvgRenderer(std::ostream &out, const ColorDef &def, const SvgOptions &opts)
+	:out(out),def(def),opts(opts) {}
+
+void Drawing::SvgRenderer::begin_content(int, std::size_t) {
 	out << R"hdr(<?xml version="1.0" encoding="UTF-8"?>)hdr";
-	out << "<svg viewBox=\"0 0 1404 1872\" xmlns=\"http://www.w3.org/2000/svg\">\r\n";
-	out << "<defs><rect id=\"viewport\" width=\"1404\" height=\"1872\" /></defs>";
+	const Box &vp = opts.viewport;
+	out << "<svg viewBox=\"" << opts.num(vp.left) << " " << opts.num(vp.top) << " "
+			<< opts.num(vp.right - vp.left) << " " << opts.num(vp.bottom - vp.top)
+			<< "\" xmlns=\"http://www.w3.org/2000/svg\">\r\n";
+	out << "<defs><rect id=\"viewport\" ";
+	if (vp.left || vp.top) out << "x=\"" << opts.num(vp.left) << "\" y=\"" << opts.num(vp.top) << "\" ";
+	out << "width=\"" << opts.num(vp.right - vp.left) << "\" height=\"" << opts.num(vp.bottom - vp.top) << "\" /></defs>";
 	out << R"css(<style>
      .maskfig path {mix-blend-mode:lighten; }
   </style>)css";
@@ -385,128 +903,289 @@ void Drawing::render_svg(std::ostream &out, const ColorDef &def) const {
       </feDisplacementMap>
     </filter>
   </defs>)flt";
-	int lrid = 1;
-	int elem_id = 1;
-	MaskQueue mask_map;
-
-	auto updateMask = [&]{
-			if (mask_map.empty()) return 0;
-			int id = elem_id++;
-			out << "<mask id=\"mask_" << id << "\">";
-			out << "<use href=\"#viewport\" fill=\"white\" />";
-			combineMasks(mask_map, out);
-			out << "</mask>";
-			return id;
-	};
+}
 
-	for (const Layer &lr: content.layers) {
-		out << "<g class=\"layer\">";
-		mask_map.clear();
-		out << "<defs>";
-		for (const Line &ln : lr.lines) {
-			int id = elem_id++;
-			switch (ln.type) {
-				case Brush::Eraser: {
-					define_eraser_mask(ln, id, out);
-					mask_map.push_back({&ln,id});
-				};break;
-				case Brush::EraseArea: {
-					define_eraseArea_mask(ln, id, out);
-					mask_map.push_back({&ln,id});
-				};break;
-				default:break;
-			}
+Drawing::SvgRenderer::SvgRenderer(std::ostream &out, const SvgRenderer &state)
+	:out(out)
+	,def(state.def)
+	,opts(state.opts)
+	,erasers(state.erasers)
+	,next_eraser(state.next_eraser)
+	,lrid(state.lrid)
+	,elem_id(state.elem_id)
+	,layer_base(state.layer_base)
+	,cur_mask(state.cur_mask)
+	,line_index(state.line_index)
+	,render_pass(state.render_pass) {}
+
+int Drawing::SvgRenderer::updateMask(bool emit) {
+	if (next_eraser >= erasers.size()) return 0;
+	int id = elem_id++;
+	if (emit) {
+		out << "<mask id=\"mask_" << id << "\">";
+		out << "<use href=\"#viewport\" fill=\"white\" />";
+		for (std::size_t i = next_eraser, cnt = erasers.size(); i < cnt; i++) {
+			if (erasers[i].box.valid()) out << "<use href=\"#eraser_" << erasers[i].id << "\" />";
 		}
-		out <<"</defs>";
-		int curMask = 0;
-		for (const Line &ln : lr.lines) {
-			if (!mask_map.empty() && mask_map.front().first == &ln) {
-				mask_map.pop_front();
-				curMask = 0;
+		out << "</mask>";
+	}
+	return id;
+}
+
+void Drawing::SvgRenderer::begin_layer(std::size_t, std::size_t) {
+	begin_pass(true);
+}
+
+void Drawing::SvgRenderer::begin_pass(bool emit) {
+	line_index = 0;
+	if (!render_pass) {
+		if (emit) out << "<g class=\"layer\">";
+		erasers.clear();
+		next_eraser = 0;
+		layer_base = elem_id;
+		if (emit) out << "<defs>";
+	} else {
+		cur_mask = 0;
+	}
+}
+
+void Drawing::SvgRenderer::end_line(const Line &ln) {
+	if (!render_pass) defineLine(ln, true);
+	else renderLine(ln, true);
+}
+
+void Drawing::SvgRenderer::defineLine(const Line &ln, bool emit) {
+	std::size_t idx = line_index++;
+	int id = elem_id++;
+	switch (ln.type) {
+		case Brush::Eraser: {
+			if (emit) define_eraser_mask(ln, id, opts, out);
+			erasers.add(idx, id, ln.getBounds());
+		};break;
+		case Brush::EraseArea: {
+			if (emit) define_eraseArea_mask(ln, id, opts, out);
+			erasers.add(idx, id, ln.getBounds());
+		};break;
+		default:break;
+	}
+}
+
+void Drawing::SvgRenderer::renderLine(const Line &ln, bool emit) {
+	std::size_t idx = line_index++;
+	if (next_eraser < erasers.size() && erasers[next_eraser].index == idx) {
+		next_eraser++;
+		cur_mask = 0;
+	}
+	if (!ln.points.empty()) {
+		switch (ln.type) {
+		case Brush::Highlighter:
+		case Brush::Fineliner: {
+			//shared mask contains all following erasers, it is used only when the line is erased
+			int mask = 0;
+			if (erasers.any(next_eraser, ln.getBounds())) {
+				if (!cur_mask) cur_mask = updateMask(emit);
+				mask = cur_mask;
 			}
-			if (!ln.points.empty()) {
-				std::string color = def.getColor(lrid, ln.type, ln.color);
-				switch (ln.type) {
-				case Brush::Highlighter:
-					if (!curMask) curMask = updateMask();
-					highlighter_to_svg(ln, color, curMask, out);
-					break;
-				case Brush::Fineliner:
-					if (!curMask) curMask = updateMask();
-					fineliner_to_svg(ln, color, curMask, out);
-					break;
-				case Brush::BallPoint:
-				case Brush::Brush:
-				case Brush::Calligraphy:
-				case Brush::Marker:
-				case Brush::Pen:
-				case Brush::SharpPencil:
-				case Brush::TiltPencil:brush_to_svg(ln, color, mask_map, out);break;
-				default:break;
-				}
+			if (emit) {
+				if (ln.type == Brush::Highlighter) highlighter_to_svg(ln, def.getColor(lrid, ln.type, ln.color), mask, opts, out);
+				else fineliner_to_svg(ln, def.getColor(lrid, ln.type, ln.color), mask, opts, out);
 			}
+		}break;
+		case Brush::BallPoint:
+		case Brush::Brush:
+		case Brush::Calligraphy:
+		case Brush::Marker:
+		case Brush::Pen:
+		case Brush::SharpPencil:
+		case Brush::TiltPencil:
+			if (emit) {
+				erasers.find(next_eraser, ln.getBounds(), brush_masks);
+				brush_to_svg(ln, layer_base+static_cast<int>(idx), def.getColor(lrid, ln.type, ln.color), brush_masks, opts, out);
+			}
+			break;
+		default:break;
 		}
-		out << "</g>\r\n";
+	}
+}
+
+bool Drawing::SvgRenderer::end_layer(std::size_t) {
+	return end_pass(true);
+}
+
+bool Drawing::SvgRenderer::end_pass(bool emit) {
+	if (!render_pass) {
+		if (emit) out <<"</defs>";
+		render_pass = true;
+		return true;
+	} else {
+		if (emit) out << "</g>\r\n";
 		lrid++;
+		render_pass = false;
+		return false;
 	}
+}
+
+void Drawing::SvgRenderer::end_content() {
 	out << "</svg>";
 }
 
-void Drawing::brush_to_mask(const Line &ln, const std::string &attrs, std::ostream &out) {
+Drawing::JsonWriter::JsonWriter(std::ostream &out, const NumFormat &num, bool columnar)
+	:out(out),num(num),columnar(columnar) {}
+
+void Drawing::JsonWriter::writeNumber(float v) {
+	if (std::isfinite(v)) out << num(v);
+	else out << "null";
+}
+
+void Drawing::JsonWriter::begin_content(int version, std::size_t) {
+	this->version = version;
+	out << "{\"layers\":[";
+}
+
+void Drawing::JsonWriter::begin_layer(std::size_t index, std::size_t) {
+	if (index) out << ',';
+	out << "{\"lines\":[";
+	first_line = true;
+}
+
+void Drawing::JsonWriter::begin_line(const Line &ln) {
+	if (!first_line) out << ',';
+	first_line = false;
+	first_point = true;
+	out << "{\"brush\":\"" << strBrush[ln.type] << "\",\"color\":\"" << strColor[ln.color] << '"';
+	if (!columnar) out << ",\"points\":[";
+}
+
+void Drawing::JsonWriter::writeColumn(const char *name, const float *values, std::size_t count) {
+	out << ",\"" << name << "\":[";
+	for (std::size_t i = 0; i < count; i++) {
+		if (i) out << ',';
+		writeNumber(values[i]);
+	}
+	out << ']';
+}
+
+void Drawing::JsonWriter::points(const Points &pts) {
+	if (columnar) {
+		writeColumn("direction", pts.direction(), pts.size());
+		writeColumn("pressure", pts.pressure(), pts.size());
+		writeColumn("speed", pts.speed(), pts.size());
+		writeColumn("width", pts.width(), pts.size());
+		writeColumn("x", pts.x(), pts.size());
+		writeColumn("y", pts.y(), pts.size());
+		return;
+	}
+	const float *x = pts.x();
+	const float *y = pts.y();
+	const float *speed = pts.speed();
+	const float *direction = pts.direction();
+	const float *width = pts.width();
+	const float *pressure = pts.pressure();
+	for (std::size_t i = 0, cnt = pts.size(); i < cnt; i++) {
+		if (!first_point) out << ',';
+		first_point = false;
+		out << "{\"direction\":"; writeNumber(direction[i]);
+		out << ",\"pressure\":"; writeNumber(pressure[i]);
+		out << ",\"speed\":"; writeNumber(speed[i]);
+		out << ",\"width\":"; writeNumber(width[i]);
+		out << ",\"x\":"; writeNumber(x[i]);
+		out << ",\"y\":"; writeNumber(y[i]);
+		out << '}';
+	}
+}
+
+void Drawing::JsonWriter::end_line(const Line &ln) {
+	if (!columnar) out << ']';
+	out << ",\"size\":";
+	writeNumber(ln.size);
+	out << ",\"unknown1\":" << ln.reserved1 << ",\"unknown2\":" << ln.reserved2 << '}';
+}
+
+bool Drawing::JsonWriter::end_layer(std::size_t) {
+	out << "]}";
+	return false;
+}
+
+void Drawing::JsonWriter::end_content() {
+	out << "],\"version\":" << version << '}';
+}
+
+float Drawing::brushOpacity(Brush type, float pressure) {
+	switch (type) {
+	case Brush::BallPoint: return std::pow(pressure,2.0f)+0.5f;
+	case Brush::TiltPencil: return std::pow(pressure,1.5f);
+	default: return 1.0f;
+	}
+}
+
+void Drawing::brush_to_mask(const Line &ln, const std::string &attrs, const SvgOptions &opts, std::ostream &out) {
+	bool coalesce = opts.coalesce > 0;
 	out<<"<g fill=\"none\" ";
-	out << "stroke-linecap=\"round\"  "
-			 << attrs <<
+	out << "stroke-linecap=\"round\"  ";
+	if (coalesce) out << "stroke-linejoin=\"round\" ";
+	out << attrs <<
 			"class=\"maskfig " << strBrush[ln.type] << "\">";
-	auto iter = ln.points.begin();
-	auto end = ln.points.end();
-	float from_x= iter->x;
-	float from_y = iter->y;
-	++iter;
-	while (iter != end) {
-		float to_x = iter->x;
-		float to_y = iter->y;
-
-		float width;
-		float opacity;
-		switch (ln.type) {
-		case Brush::BallPoint: width = iter->width;
-							   opacity = std::pow(iter->pressure,2.0f)+0.5;
-							   break;
-		case Brush::TiltPencil: width = iter->width;
-							   opacity = std::pow(iter->pressure,1.5f);
-							   break;
-
-		default: width  = iter->width;
-				 opacity = 1.0f;
+	const float *x = ln.points.x();
+	const float *y = ln.points.y();
+	const float *w = ln.points.width();
+	const float *p = ln.points.pressure();
+	//step of the gray level, when segments are merged
+	int level_step = static_cast<int>(std::clamp(opts.coalesce * (255.0f/8.0f) + 0.5f, 1.0f, 255.0f));
+	//bucket of the current path
+	float cur_width = 0;
+	int cur_col = -1;
+	PathWriter path(opts, out);
+	std::size_t cnt = ln.points.size();
+	for (std::size_t i = 1; i < cnt; i++) {
+
+		float width = w[i] * width_factor;
+		int col = std::min(255,static_cast<int>(brushOpacity(ln.type, p[i]) * 255.0));
+		if (coalesce) {
+			//thin segment, which would be rounded to zero, keeps its width
+			float bucket = std::round(width / opts.coalesce) * opts.coalesce;
+			if (bucket > 0) width = bucket;
+			col = std::min(255, (col + level_step/2) / level_step * level_step);
+			if (col == cur_col && width == cur_width) {
+				path.lineTo(x[i], y[i]);
+				continue;
+			}
+			if (cur_col >= 0) {
+				path.finish();
+				out << "\" />";
+			}
+			cur_col = col;
+			cur_width = width;
 		}
-		out << "<path stroke-width=\"" << width * width_factor << "\" "
-		    << "d=\"M " << from_x << " " << from_y << " L " << to_x << " " << to_y <<"\" ";
-		int col = std::min(255,static_cast<int>(opacity * 255.0));
 		col = (col << 0)| (col << 8) | (col << 16);
-		out << "stroke=\"#" << std::setfill('0') << std::setw(6) << std::hex << col << "\" " << std::dec;;
-		out << "/>";
-
-		from_x= to_x;
-		from_y= to_y;
-		++iter;
+		out << "<path stroke=\"#" << std::setfill('0') << std::setw(6) << std::hex << col << "\" " << std::dec;
+		out << "stroke-width=\"" << opts.num(width) << "\" d=\"";
+		path.moveTo(x[i-1], y[i-1]);
+		path.lineTo(x[i], y[i]);
+		if (!coalesce) {
+			path.finish();
+			out << "\" />";
+		}
+	}
+	if (cur_col >= 0) {
+		path.finish();
+		out << "\" />";
 	}
 	out<<"</g>";
 
 }
 
-void Drawing::brush_to_svg(const Line &ln, const std::string &color, const MaskQueue &mqueue, std::ostream &out) {
-	std::string maskAttr;
-	std::string commonId = std::to_string(reinterpret_cast<std::uintptr_t>(&ln));
+void Drawing::brush_to_svg(const Line &ln, int id, const std::string &color, const std::vector<int> &masks, const SvgOptions &opts, std::ostream &out) {
+	std::string commonId = std::to_string(id);
 	out << "<mask id=\"fig_" << commonId << "\">";
 	if (ln.type == Brush::TiltPencil || ln.type == Brush::SharpPencil) {
-		brush_to_mask(ln,"filter=\"url(#pencilTexture)\" ",out);
+		brush_to_mask(ln,"filter=\"url(#pencilTexture)\" ",opts,out);
 	} else {
-		brush_to_mask(ln,"",out);
+		brush_to_mask(ln,"",opts,out);
 	}
-	combineMasks(mqueue, out);
+	combineMasks(masks, out);
 	out << "</mask>";
 	auto box = ln.getBounds();
-	out << "<rect mask=\"url(#fig_" << commonId << "\" x=\"" << box.left << "\" y=\"" << box.top << "\" width=\"" << (box.right-box.left) << "\" height=\"" << (box.bottom-box.top) << "\" fill=\"" <<color<< "\" />";
+	out << "<rect mask=\"url(#fig_" << commonId << "\" x=\"" << opts.num(box.left) << "\" y=\"" << opts.num(box.top) << "\" width=\"" << opts.num(box.right-box.left) << "\" height=\"" << opts.num(box.bottom-box.top) << "\" fill=\"" <<color<< "\" />";
 }
 
 Drawing::Box Drawing::Box::merge(const Box &other) const {
@@ -520,65 +1199,116 @@ Drawing::Box Drawing::Box::merge(const Box &other) const {
 	};
 }
 
-void Drawing::Line::smoothLine(unsigned int cnt) {
-	std::vector<Point> nwpt;
-	while (points.size()>2 && cnt > 0) {
-		std::size_t sz = points.size();
-		nwpt.reserve(sz);
-		nwpt.push_back(points[0]);
-		for (std::size_t i = 2; i < sz-1; i++) {
-			const auto &pt1 = points[i-1];
-			const auto &pt2 = points[i];
-			nwpt.push_back(Point{
-				(pt1.x + pt2.x) *0.5f,
-				(pt1.y + pt2.y) *0.5f,
-				(pt1.speed + pt2.speed) *0.5f,
-				(pt1.direction + pt2.direction) *0.5f,
-				(pt1.width + pt2.width) *0.5f,
-				(pt1.pressure + pt2.pressure) *0.5f
-			});
+void Drawing::Line::smoothLine(unsigned int cnt, unsigned int columns) {
+	std::size_t sz = points.size();
+	if (sz <= 2 || cnt == 0) return;
+	std::size_t newsz = sz;
+	for (int c = 0; c < Points::column_count; c++) {
+		Points::Column col = static_cast<Points::Column>(c);
+		float *data = points.column(col);
+		if (columns & Points::bit(col)) {
+			newsz = point_kernels::smooth(data, sz, cnt);
+		} else {
+			newsz = sz - std::min<std::size_t>(cnt, sz - 2);
+			data[newsz-1] = data[sz-1];
 		}
-		nwpt.push_back(points.back());
-		std::swap(nwpt, points);
-		nwpt.clear();
-		cnt--;
 	}
+	points.truncate(newsz);
+}
+
+void Drawing::Line::simplify(float tolerance) {
+	std::size_t sz = points.size();
+	if (sz <= 2 || !(tolerance > 0)) return;
+	//scratch buffers are reused by the thread
+	static thread_local std::vector<unsigned char> keep;
+	static thread_local std::vector<std::size_t> stack;
+	if (keep.size() < sz) keep.resize(sz);
+	std::size_t newsz = point_kernels::simplify(points.x(), points.y(), sz, tolerance, keep.data(), stack);
+	if (newsz == sz) return;
+	for (int c = 0; c < Points::column_count; c++) {
+		point_kernels::compact(points.column(static_cast<Points::Column>(c)), keep.data(), sz);
+	}
+	points.truncate(newsz);
+}
+
+void Drawing::Line::accumulateBounds(float bounds[4]) const {
+	if (points.empty()) return;
+	float x0 = points.x()[0];
+	float y0 = points.y()[0];
+	bounds[0] = std::min(bounds[0], x0);
+	bounds[1] = std::min(bounds[1], y0);
+	bounds[2] = std::max(bounds[2], x0);
+	bounds[3] = std::max(bounds[3], y0);
+	point_kernels::accumulateBounds(points.x(), points.y(), points.width(), points.size(), bounds);
+}
+
+static Drawing::Box boundsToBox(const float bounds[4]) {
+	if (bounds[0] > bounds[2]) return {1,1,0,0};
+	return {bounds[0], bounds[1], bounds[2], bounds[3]};
 }
 
+static constexpr float empty_bounds_init[4] = {
+		std::numeric_limits<float>::max(),
+		std::numeric_limits<float>::max(),
+		std::numeric_limits<float>::lowest(),
+		std::numeric_limits<float>::lowest()
+};
+
 Drawing::Box Drawing::Line::getBounds() const {
 	if (points.empty()) return {1,1,0,0};
-	Box bx {points[0].x,points[0].y, points[0].x, points[0].y};
-	for (const auto &pt: points) {
-		bx.left = std::min(bx.left, pt.x-pt.width);
-		bx.top= std::min(bx.top, pt.y-pt.width);
-		bx.right = std::max(bx.right, pt.x+pt.width);
-		bx.bottom= std::max(bx.bottom, pt.y+pt.width);
+	float bounds[4] = {points.x()[0], points.y()[0], points.x()[0], points.y()[0]};
+	point_kernels::accumulateBounds(points.x(), points.y(), points.width(), points.size(), bounds);
+	return boundsToBox(bounds);
+}
+
+//Calls fn for every line. Lines of large layer are processed in parallel when pool is set
+template<typename Fn>
+static void forEachLine(std::vector<Drawing::Line> &lines, WorkerPool *pool, Fn &&fn) {
+	//minimal count of points of the layer to process lines in parallel
+	static constexpr std::size_t parallel_threshold = 20000;
+	if (pool && pool->getThreads() > 1) {
+		std::size_t total = 0;
+		for (const auto &l: lines) total += l.points.size();
+		if (total >= parallel_threshold) {
+			pool->parallel_for(lines.size(), [&](std::size_t idx){
+				fn(lines[idx]);
+			});
+			return;
+		}
 	}
-	return bx;
+	for (auto &l: lines) fn(l);
+}
+
+void Drawing::Layer::smoothLine(unsigned int cnt, unsigned int columns, WorkerPool *pool) {
+	forEachLine(lines, pool, [&](Line &l){l.smoothLine(cnt, columns);});
+}
+
+void Drawing::Layer::simplify(float tolerance, WorkerPool *pool) {
+	forEachLine(lines, pool, [&](Line &l){l.simplify(tolerance);});
 }
 
-void Drawing::Layer::smoothLine(unsigned int cnt) {
-	for (auto &l: lines) l.smoothLine(cnt);
+void Drawing::Layer::accumulateBounds(float bounds[4]) const {
+	for (const auto &ln: lines) ln.accumulateBounds(bounds);
 }
 
 Drawing::Box Drawing::Layer::getBounds() const {
-	Box bx{1,1,0,0};
-	for (const auto &ln: lines) {
-		bx = bx.merge(ln.getBounds());
-	}
-	return bx;
+	float bounds[4] = {empty_bounds_init[0], empty_bounds_init[1], empty_bounds_init[2], empty_bounds_init[3]};
+	accumulateBounds(bounds);
+	return boundsToBox(bounds);
 }
 
-void Drawing::Content::smoothLine(unsigned int cnt) {
-	for (auto &l: layers) l.smoothLine(cnt);
+void Drawing::Content::smoothLine(unsigned int cnt, unsigned int columns, WorkerPool *pool) {
+	for (auto &l: layers) l.smoothLine(cnt, columns, pool);
+}
+
+void Drawing::Content::simplify(float tolerance, WorkerPool *pool) {
+	for (auto &l: layers) l.simplify(tolerance, pool);
 }
 
 Drawing::Box Drawing::Content::getBounds() const {
-	Box bx{1,1,0,0};
-	for (const auto &lr: layers) {
-		bx = bx.merge(lr.getBounds());
-	}
-	return bx;
+	float bounds[4] = {empty_bounds_init[0], empty_bounds_init[1], empty_bounds_init[2], empty_bounds_init[3]};
+	for (const auto &lr: layers) lr.accumulateBounds(bounds);
+	return boundsToBox(bounds);
 }
 
 void Drawing::ColorDef::prepare() {
@@ -8,13 +8,20 @@
 #ifndef SRC_MAIN_RMPARSER_H_
 #define SRC_MAIN_RMPARSER_H_
 
-#include <deque>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <string_view>
 #include <vector>
 
 #include <imtjson/value.h>
 #include <imtjson/namedEnum.h>
+#include "numformat.h"
 #include "sorted_vector.h"
+
+class WorkerPool;
+
 class Drawing {
 public:
 
@@ -42,13 +49,50 @@ public:
 	struct Box {
 		float left,top,right,bottom;
 		Box merge(const Box &other) const;
+		bool empty() const {return left > right || top > bottom;}
+		///Box is not empty and no coordinate is NaN
+		bool valid() const {return left <= right && top <= bottom;}
+		bool intersects(const Box &other) const {
+			return !empty() && !other.empty()
+					&& left <= other.right && other.left <= right
+					&& top <= other.bottom && other.top <= bottom;
+		}
+	};
+
+	///Size of the page
+	static constexpr int page_width = 1404;
+	static constexpr int page_height = 1872;
+
+	///Uniform grid over the page (spatial index)
+	/**
+	 * Coordinates outside of the page are mapped to the border cells
+	 */
+	class PageGrid {
+	public:
+		static constexpr int cell_size = 128;
+		static constexpr int cols = (page_width + cell_size - 1) / cell_size;
+		static constexpr int rows = (page_height + cell_size - 1) / cell_size;
+
+		///Calculates range of cells covered by the box
+		/**
+		 * @return false, when box is empty or a coordinate is NaN
+		 */
+		static bool cellRange(const Box &box, int &c1, int &r1, int &c2, int &r2);
 	};
 
+	///Decoder state - reads directly from the memory (file can be mapped)
 	struct Stream {
 		int version;
 		bool swap_endian;
-		std::istream &stream;
-
+		const char *pos;
+		const char *end;
+
+		///Takes count of bytes from the stream
+		/**
+		 * @param bytes count of bytes to take
+		 * @return pointer to first byte. Throws exception, when stream is truncated
+		 */
+		const char *take(std::size_t bytes);
 	};
 
 	struct Point {
@@ -59,7 +103,99 @@ public:
 		float width;
 		float pressure;
 
-		void read(const Stream &stream);
+		static constexpr std::size_t binary_size = 6*sizeof(float);
+	};
+
+	///Points of the line stored as separate columns (structure of arrays)
+	class Points {
+	public:
+		enum Column {
+			col_x, col_y, col_speed, col_direction, col_width, col_pressure,
+			column_count
+		};
+
+		///Converts column to bit of the column mask
+		static constexpr unsigned int bit(Column c) {return 1U << c;}
+		///Mask of all columns
+		static constexpr unsigned int all_columns = (1U << column_count) - 1;
+		///Mask of columns needed to render SVG
+		static constexpr unsigned int svg_columns = (1U << col_x)|(1U << col_y)|(1U << col_width)|(1U << col_pressure);
+
+		std::size_t size() const {return count;}
+		bool empty() const {return count == 0;}
+		///Resizes container, content is not preserved. Container uses own buffer
+		void resize(std::size_t count);
+		///Shrinks container, content is preserved
+		void truncate(std::size_t count);
+		///Uses external buffer (see PointArena), content is not preserved
+		/**
+		 * @param buffer buffer for count*column_count floats. Buffer is not
+		 * owned, and it is shared when the container is copied
+		 * @param count count of points
+		 */
+		void assign(float *buffer, std::size_t count);
+
+		float *column(Column c) {return base()+c*stride;}
+		const float *column(Column c) const {return base()+c*stride;}
+		const float *x() const {return column(col_x);}
+		const float *y() const {return column(col_y);}
+		const float *speed() const {return column(col_speed);}
+		const float *direction() const {return column(col_direction);}
+		const float *width() const {return column(col_width);}
+		const float *pressure() const {return column(col_pressure);}
+
+		Point operator[](std::size_t idx) const;
+		Point front() const {return operator[](0);}
+		Point back() const {return operator[](count-1);}
+		void set(std::size_t idx, const Point &pt);
+
+		class const_iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = Point;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const Point *;
+			using reference = Point;
+
+			const_iterator(const Points *owner, std::size_t idx):owner(owner),idx(idx) {}
+			Point operator*() const {return (*owner)[idx];}
+			const_iterator &operator++() {++idx; return *this;}
+			const_iterator operator++(int) {return const_iterator(owner, idx++);}
+			bool operator==(const const_iterator &other) const {return idx == other.idx;}
+			bool operator!=(const const_iterator &other) const {return idx != other.idx;}
+		protected:
+			const Points *owner;
+			std::size_t idx;
+		};
+
+		const_iterator begin() const {return const_iterator(this, 0);}
+		const_iterator end() const {return const_iterator(this, count);}
+
+	protected:
+		std::vector<float> data;
+		float *ext = nullptr;
+		std::size_t count = 0;
+		std::size_t stride = 0;
+
+		float *base() {return ext?ext:data.data();}
+		const float *base() const {return ext?ext:data.data();}
+	};
+
+	///Monotonic buffer for points of the whole page
+	/**
+	 * The buffer is reused, it only grows, so when it is reused for similar
+	 * pages, no allocation is needed
+	 */
+	class PointArena {
+	public:
+		///Releases all allocations and makes room for given count of floats
+		void reset(std::size_t floats);
+		///Allocates floats. Total allocation must fit to the size passed to reset()
+		float *alloc(std::size_t floats);
+	protected:
+		std::unique_ptr<float[]> buffer;
+		std::size_t capacity = 0;
+		std::size_t used = 0;
 	};
 
 	struct Line {
@@ -68,31 +204,125 @@ public:
 		float size;
 		int reserved1;
 		int reserved2;
-		std::vector<Point> points;
-
-		void read(const Stream &stream);
-		void smoothLine(unsigned int cnt);
+		Points points;
+
+		///Reads line header only, points must be read separately
+		void readHeader(Stream &stream);
+		///Smooths the line
+		/**
+		 * @param cnt count of passes
+		 * @param columns mask of columns to smooth (see Points::bit). Other columns
+		 * are only truncated
+		 */
+		void smoothLine(unsigned int cnt, unsigned int columns = Points::all_columns);
+		///Removes points using Ramer-Douglas-Peucker algorithm
+		/**
+		 * @param tolerance maximal distance of removed point from the simplified line
+		 */
+		void simplify(float tolerance);
 		Box getBounds() const;
+		///Merges bounds of the line to the bounds (left, top, right, bottom)
+		void accumulateBounds(float bounds[4]) const;
 
 	};
 
 	struct Layer {
 		std::vector<Line> lines;
 
-		void read(const Stream &stream);
-		void smoothLine(unsigned int cnt);
+		void read(Stream &stream, PointArena &arena);
+		///Smooths all lines, lines can be processed in parallel when pool is set
+		void smoothLine(unsigned int cnt, unsigned int columns = Points::all_columns, WorkerPool *pool = nullptr);
+		///Simplifies all lines, lines can be processed in parallel when pool is set
+		void simplify(float tolerance, WorkerPool *pool = nullptr);
 		Box getBounds() const;
+		///Merges bounds of all lines to the bounds (left, top, right, bottom)
+		void accumulateBounds(float bounds[4]) const;
 	};
 
+	class Visitor;
+
+	///Content of the page
+	/**
+	 * All points of the page are stored in the single buffer (arena), lines
+	 * reference this buffer. When the content is read again, the buffer and the
+	 * containers are reused. The content can be moved, but it can't be copied
+	 */
 	struct Content {
-		int version;
+		int version = 0;
 		std::vector<Layer> layers;
+		PointArena arena;
+
+		Content() = default;
+		Content(Content &&) = default;
+		Content &operator=(Content &&) = default;
+		Content(const Content &) = delete;
+		Content &operator=(const Content &) = delete;
 
 		void read(std::istream &in);
-		void smoothLine(unsigned int cnt);
+		///Decodes content directly from the memory (for example mapped file)
+		void read(const std::string_view &data);
+		void smoothLine(unsigned int cnt, unsigned int columns = Points::all_columns, WorkerPool *pool = nullptr);
+		void simplify(float tolerance, WorkerPool *pool = nullptr);
 		Box getBounds() const;
+		///Generates visitor's events from the content
+		void visit(Visitor &visitor) const;
 	};
 
+	///Spatial index of the lines of the page
+	class LineIndex: public PageGrid {
+	public:
+		struct Entry {
+			std::uint32_t layer;
+			std::uint32_t line;
+
+			bool operator<(const Entry &other) const {
+				return layer < other.layer || (layer == other.layer && line < other.line);
+			}
+			bool operator==(const Entry &other) const {
+				return layer == other.layer && line == other.line;
+			}
+		};
+
+		void build(const Content &content);
+		///Finds lines which intersect the box
+		/**
+		 * @param box box
+		 * @param result receives found lines ordered by the layer and the line
+		 */
+		void find(const Box &box, std::vector<Entry> &result) const;
+		///Returns bounds of the line
+		const Box &getBounds(const Entry &e) const {return bounds[e.layer][e.line];}
+
+	protected:
+		std::vector<std::vector<Box> > bounds;
+		std::vector<std::vector<Entry> > cells;
+	};
+
+	///Receives events from the parser (see parse_rm) or from the content (see Content::visit)
+	class Visitor {
+	public:
+		virtual ~Visitor() {}
+		virtual void begin_content(int /*version*/, std::size_t /*layers*/) {}
+		virtual void begin_layer(std::size_t /*index*/, std::size_t /*lines*/) {}
+		///Begin of line, points are not available yet
+		virtual void begin_line(const Line &/*ln*/) {}
+		///Points of the line
+		virtual void points(const Points &/*pts*/) {}
+		///End of line, line is complete, including the points
+		virtual void end_line(const Line &/*ln*/) {}
+		///End of layer
+		/**
+		 * @retval true replay the layer - visitor receives all events of the layer again
+		 * @retval false continue by next layer
+		 */
+		virtual bool end_layer(std::size_t /*index*/) {return false;}
+		virtual void end_content() {}
+	};
+
+	class SvgRenderer;
+	class JsonWriter;
+	class BinWriter;
+
 
 	struct OutColor {
 		std::string black_color, gray_color, white_color;
@@ -110,43 +340,356 @@ public:
 		void prepare();
 	};
 
+	///Default count of decimal places of coordinates in SVG
+	static constexpr int svg_decimals = 2;
+	///Default formatting of numbers in JSON (see write_json) - without rounding, same as toJSON
+	static constexpr int json_decimals = NumFormat::shortest;
+
+	///Default tolerance of merging brush segments (see SvgOptions::coalesce)
+	static constexpr float svg_coalesce = 0.25f;
+	///Default grid of compact SVG paths (see SvgOptions::grid)
+	static constexpr float svg_grid = 1.0f;
+	///Default compression level of the PNG output
+	static constexpr int png_level = 4;
+	///Max count of pixels of the bitmap (see rasterize)
+	static constexpr std::size_t max_bitmap_pixels = 256*1024*1024;
+	///Default count of decimal places of the binary output
+	static constexpr int bin_decimals = 2;
+
+	///Options of the SVG output
+	struct SvgOptions {
+		///Formatting of the numbers
+		NumFormat num;
+		///Tolerance of merging segments of the brush to a single path
+		/**
+		 * Width of the segment is rounded to multiple of this value (in pixels), and
+		 * opacity is rounded to multiple of 1/8 of this value. Consecutive segments
+		 * with same rounded width and opacity are rendered as single path. Set 0 to
+		 * render each segment separately
+		 */
+		float coalesce;
+		///Compact paths
+		/**
+		 * Coordinates are rounded to the grid, and paths are written using relative
+		 * commands without redundant separators
+		 */
+		bool compact;
+		///Size of the grid in compact mode
+		float grid;
+		///Visible area of the page (viewBox)
+		Box viewport;
+
+		SvgOptions():num(svg_decimals),coalesce(svg_coalesce),compact(false),grid(svg_grid)
+			,viewport{0,0,page_width,page_height} {}
+	};
+
+	///Options of the PNG output
+	struct PngOptions {
+		///Pixels per unit of the page
+		float scale;
+		///Rendered area of the page
+		Box viewport;
+		///Compression level (zlib)
+		int level;
+
+		PngOptions():scale(1.0f),viewport{0,0,page_width,page_height},level(png_level) {}
+	};
+
+	///Options of the binary output (see BinWriter)
+	struct BinOptions {
+		///Mask of written columns (see Points::bit)
+		unsigned int columns;
+		///Store values as float16. Otherwise values are quantized and delta encoded
+		bool half;
+		///Quantization step is 10^-decimals (0-6)
+		int decimals;
+
+		BinOptions():columns(Points::svg_columns),half(false),decimals(bin_decimals) {}
+	};
+
+	///RGB image (see rasterize)
+	struct Bitmap {
+		unsigned int width = 0;
+		unsigned int height = 0;
+		///pixels, 3 bytes per pixel, rows from top to bottom
+		std::vector<unsigned char> rgb;
+	};
+
 	const Content &getContent() const;
 
 
 	json::Value toJSON() const;
-	void render_svg(std::ostream &out, const ColorDef &def) const;
+	///Writes JSON (same schema as toJSON) directly to the stream
+	/**
+	 * @param out output stream
+	 * @param num formatting of the numbers
+	 * @param columnar use columnar layout (see JsonWriter)
+	 */
+	void write_json(std::ostream &out, const NumFormat &num = NumFormat(json_decimals), bool columnar = false) const;
+	///Writes binary format (see BinWriter)
+	void write_bin(std::ostream &out, const BinOptions &opts = BinOptions()) const;
+	///Renders SVG
+	/**
+	 * @param out output stream
+	 * @param def color definition
+	 * @param opts output options
+	 * @param pool optional pool. Large pages are rendered in parallel, output is
+	 * same as the output of serial rendering
+	 */
+	void render_svg(std::ostream &out, const ColorDef &def, const SvgOptions &opts = SvgOptions(), WorkerPool *pool = nullptr) const;
+	///Renders page to the bitmap
+	/**
+	 * Strokes are drawn with anti-aliasing on white background. Pencil texture is
+	 * not rendered. The result doesn't depend on count of threads
+	 *
+	 * @param bmp target bitmap
+	 * @param def color definition
+	 * @param opts output options (compression level is ignored)
+	 * @param pool optional pool, tiles of the bitmap are rendered in parallel
+	 */
+	void rasterize(Bitmap &bmp, const ColorDef &def, const PngOptions &opts = PngOptions(), WorkerPool *pool = nullptr);
+	///Renders page as PNG
+	void render_png(std::ostream &out, const ColorDef &def, const PngOptions &opts = PngOptions(), WorkerPool *pool = nullptr);
+	///Calculates size of the bitmap
+	/**
+	 * @param opts output options
+	 * @param max_pixels max count of pixels (at most 2^31)
+	 * @param width receives width of the bitmap
+	 * @param height receives height of the bitmap
+	 * @retval true size is valid
+	 * @retval false scale or viewport is invalid, or the bitmap would be larger
+	 * than max_pixels. Width and height are undefined
+	 */
+	static bool bitmapSize(const PngOptions &opts, std::size_t max_pixels, unsigned int &width, unsigned int &height);
 
 	static json::NamedEnum<Color> strColor;
 	static json::NamedEnum<Brush> strBrush;
 
 	void load_rm(std::istream &in);
-	void smooth(unsigned int cnt) {content.smoothLine(cnt);}
+	///Load drawing from the memory (mapped file). Data are not referenced after return
+	void load_rm(const std::string_view &data);
+	void smooth(unsigned int cnt, unsigned int columns = Points::all_columns, WorkerPool *pool = nullptr) {
+		content.smoothLine(cnt, columns, pool);
+		index_valid = false;
+	}
+	///Simplifies lines (see Line::simplify)
+	void simplify(float tolerance, WorkerPool *pool = nullptr) {
+		content.simplify(tolerance, pool);
+		index_valid = false;
+	}
+	///Returns spatial index of the lines, index is built when needed (used by the rasterizer, one query per tile)
+	const LineIndex &getIndex();
+	///Removes lines, which don't intersect the box. Layers are kept
+	void clip(const Box &box);
+
+	///Parses .rm file from the memory and sends events to the visitor
+	/**
+	 * Content is not materialized, only one line is held in the memory
+	 */
+	static void parse_rm(const std::string_view &data, Visitor &visitor);
+	///Checks structure of the .rm file without decoding the points
+	/**
+	 * Throws exception when file is not valid
+	 */
+	static void check_rm(const std::string_view &data);
+	///Decodes binary format (see BinWriter) and sends events to the visitor
+	/**
+	 * Reference decoder of the format. Columns which are not stored are set to
+	 * zero. Throws exception when data are not valid
+	 */
+	static void parse_bin(const std::string_view &data, Visitor &visitor);
 
 
 protected:
 
 	Content content;
-	using MaskQueue = std::deque<std::pair<const Line *, int> >;
-
+	LineIndex index;
+	bool index_valid = false;
+	///Erasers of the layer with the spatial index
+	class EraserIndex: public PageGrid {
+	public:
+		struct Eraser {
+			///index of the line
+			std::size_t index;
+			///id of the mask
+			int id;
+			Box box;
+		};
+
+		void clear();
+		void add(std::size_t index, int id, const Box &box);
+		std::size_t size() const {return erasers.size();}
+		const Eraser &operator[](std::size_t pos) const {return erasers[pos];}
+		///Finds erasers which intersect the box
+		/**
+		 * @param first position of the first eraser to search
+		 * @param box box
+		 * @param ids receives ids of found erasers in order of the erasers
+		 */
+		void find(std::size_t first, const Box &box, std::vector<int> &ids) const;
+		///Returns true, if any eraser from the position intersects the box
+		bool any(std::size_t first, const Box &box) const;
+
+	protected:
+		//each cell contains positions of the erasers, which intersect it
+		//minimal count of erasers to use cells, otherwise all erasers are tested
+		static constexpr std::size_t index_threshold = 16;
+
+		std::vector<Eraser> erasers;
+		std::vector<std::vector<std::uint32_t> > cells;
+		mutable std::vector<std::uint32_t> found;
+
+		void build();
+	};
 
-	static int readInt32(const Stream &stream);
-	static float readFloat32(const Stream &stream);
-	template<typename T>
-	static void readArray(std::vector<T> &cont, const Stream &stream);
-	static Color readColor(const Stream &stream);
-	static Brush readBrush(const Stream &stream);
 
-	static void highlighter_to_svg(const Line &ln, const std::string &color, int maskId, std::ostream &out);
-	static void fineliner_to_svg(const Line &ln, const std::string &color, int maskId, std::ostream &out);
-	static void brush_to_svg(const Line &ln, const std::string &color, const MaskQueue &mqueue, std::ostream &out);
-	static void brush_to_mask(const Line &ln, const std::string &attrs, std::ostream &out);
-	static void define_eraser_mask(const Line &ln, int id, std::ostream &out);
-	static void define_eraseArea_mask(const Line &ln, int id, std::ostream &out);
+	static int decodeInt32(const char *data, bool swap_endian);
+	static float decodeFloat32(const char *data, bool swap_endian);
+	static std::size_t readHeader(const std::string_view &data, Stream &stream);
+	static int readInt32(Stream &stream);
+	static float readFloat32(Stream &stream);
+	static std::size_t readCount(Stream &stream);
+	static const char *readPointsBlock(Stream &stream, std::size_t &entries);
+	static void readArray(Points &cont, Stream &stream);
+	static void readArray(Points &cont, Stream &stream, PointArena &arena);
+	static void decodePoints(Points &cont, const char *data, bool swap_endian);
+	///Skips layers (validates the structure), returns count of points
+	static std::size_t skipLayers(Stream &stream, std::size_t layers);
+	static Color decodeColor(int c);
+	static Brush decodeBrush(int c);
+
+	///Writes path data of the line (content of the attribute d)
+	static void path_to_svg(const Points &pts, bool close, const SvgOptions &opts, std::ostream &out);
+	static void highlighter_to_svg(const Line &ln, const std::string &color, int maskId, const SvgOptions &opts, std::ostream &out);
+	static void fineliner_to_svg(const Line &ln, const std::string &color, int maskId, const SvgOptions &opts, std::ostream &out);
+	static void brush_to_svg(const Line &ln, int id, const std::string &color, const std::vector<int> &masks, const SvgOptions &opts, std::ostream &out);
+	static void brush_to_mask(const Line &ln, const std::string &attrs, const SvgOptions &opts, std::ostream &out);
+	static void define_eraser_mask(const Line &ln, int id, const SvgOptions &opts, std::ostream &out);
+	static void define_eraseArea_mask(const Line &ln, int id, const SvgOptions &opts, std::ostream &out);
+
+	///Opacity of the brush stroke
+	static float brushOpacity(Brush type, float pressure);
 
 	static float width_factor;
 
 };
 
+///Renders SVG from the events
+class Drawing::SvgRenderer: public Drawing::Visitor {
+public:
+	SvgRenderer(std::ostream &out, const ColorDef &def, const SvgOptions &opts = SvgOptions());
+	///Creates renderer which continues from the state of other renderer
+	SvgRenderer(std::ostream &out, const SvgRenderer &state);
+
+	virtual void begin_content(int version, std::size_t layers) override;
+	virtual void begin_layer(std::size_t index, std::size_t lines) override;
+	virtual void end_line(const Line &ln) override;
+	virtual bool end_layer(std::size_t index) override;
+	virtual void end_content() override;
+
+protected:
+	std::ostream &out;
+	const ColorDef &def;
+	SvgOptions opts;
+	//erasers of the current layer
+	EraserIndex erasers;
+	//position of the first eraser, which follows current line
+	std::size_t next_eraser = 0;
+	//ids of erasers of the current brush
+	std::vector<int> brush_masks;
+	int lrid = 1;
+	int elem_id = 1;
+	//first element id of current layer
+	int layer_base = 1;
+	int cur_mask = 0;
+	std::size_t line_index = 0;
+	//false - first pass (masks), true - second pass (strokes)
+	bool render_pass = false;
+
+	//following functions update the state, they generate output only when emit is true.
+	//This allows to calculate state at any line without rendering (see Drawing::render_svg)
+
+	void begin_pass(bool emit);
+	bool end_pass(bool emit);
+	void defineLine(const Line &ln, bool emit);
+	void renderLine(const Line &ln, bool emit);
+	int updateMask(bool emit);
+
+	friend class Drawing;
+};
+
+///Writes JSON from the events
+/**
+ * Default layout is same as toJSON - each point is an object. In columnar layout,
+ * the line contains an array for each column ("direction", "pressure", "speed",
+ * "width", "x", "y") instead of the array "points"
+ */
+class Drawing::JsonWriter: public Drawing::Visitor {
+public:
+	JsonWriter(std::ostream &out, const NumFormat &num = NumFormat(json_decimals), bool columnar = false);
+
+	virtual void begin_content(int version, std::size_t layers) override;
+	virtual void begin_layer(std::size_t index, std::size_t lines) override;
+	virtual void begin_line(const Line &ln) override;
+	virtual void points(const Points &pts) override;
+	virtual void end_line(const Line &ln) override;
+	virtual bool end_layer(std::size_t index) override;
+	virtual void end_content() override;
+
+protected:
+	std::ostream &out;
+	NumFormat num;
+	bool columnar;
+	int version = 0;
+	bool first_line = true;
+	bool first_point = true;
+
+	void writeNumber(float v);
+	void writeColumn(const char *name, const float *values, std::size_t count);
+};
+
+///Writes compact binary format from the events
+/**
+ * All numbers are little endian. Varint is unsigned LEB128, signed values are
+ * zigzag encoded. Format:
+ *
+ * @code
+ * header:  "RMLB", u8 format version (1), u8 flags (bit 0 - float16),
+ *          u8 columns (mask, see Points::bit), u8 decimals, u8 version of .rm,
+ *          varint count of layers
+ * layer:   varint count of lines
+ * line:    u8 brush, u8 color (ordinals of the enums), f32 size,
+ *          varint count of points, then values of each stored column
+ *          (in order of Points::Column)
+ * @endcode
+ *
+ * Values of the column are either float16, or differences between
+ * consecutive values rounded to multiple of 10^-decimals, the first value
+ * is difference from zero. Non-finite values are stored as zero
+ */
+class Drawing::BinWriter: public Drawing::Visitor {
+public:
+	static constexpr unsigned char format_version = 1;
+	static constexpr unsigned char flag_half = 1;
+
+	BinWriter(std::ostream &out, const BinOptions &opts = BinOptions());
+
+	virtual void begin_content(int version, std::size_t layers) override;
+	virtual void begin_layer(std::size_t index, std::size_t lines) override;
+	virtual void begin_line(const Line &ln) override;
+	virtual void points(const Points &pts) override;
+
+protected:
+	std::ostream &out;
+	unsigned int columns;
+	bool half;
+	int decimals;
+	double mult;
+	//encoded line, the line is written at once
+	std::string buffer;
+
+	void writeVarint(std::uint64_t v);
+};
 
 
 
@@ -10,15 +10,22 @@
 
 #include "rmrpcfsys.h"
 
+#include <algorithm>
 #include <cctype>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
 #include <iterator>
+#include <optional>
+#include <sstream>
+#include <sys/stat.h>
 
 #include <imtjson/object.h>
 #include <imtjson/serializer.h>
 #include <imtjson/operations.h>
 #include <shared/logOutput.h>
-#include <shared/streams.h>
 #include <userver/query_parser.h>
+#include <pdf/mapped_file.h>
 #include "csscolor.h"
 #include "rmparser.h"
 
@@ -27,12 +34,32 @@ using ondra_shared::logError;
 using ondra_shared::logWarning;
 
 
-RmRpcFSys::RmRpcFSys(const std::string_view &rootPath):root(rootPath) {
+RmRpcFSys::RmRpcFSys(const std::string_view &rootPath, unsigned int render_threads, std::size_t cache_size,
+		const std::string &catalog_snapshot)
+	:root(rootPath)
+	,pool(render_threads?render_threads:std::thread::hardware_concurrency())
+	,cache(cache_size)
+	,watch(createWatch())
+	,catalog(root, watch.get(), catalog_snapshot)
+	,manifests(root, watch.get())
+	,search_index(root, watch.get()) {
+	//events are held for the subscribers, which are still loading
+	if (watch) watch->start();
+}
 
+std::unique_ptr<FsWatch> RmRpcFSys::createWatch() {
+	try {
+		return std::make_unique<FsWatch>();
+	} catch (const std::exception &e) {
+		logError("Can't create watch: $1", e.what());
+		return nullptr;
+	}
 }
 
 void RmRpcFSys::initRpc(std::shared_ptr<RmRpcFSys> me, json::RpcServer &rpc) {
-
+	rpc.add("search", [me](json::RpcRequest req){
+		me->search(req);
+	});
 }
 
 std::string_view RmRpcFSys::vpathToFileID(std::string_view vpath) {
@@ -84,62 +111,176 @@ void RmRpcFSys::initHttp(std::shared_ptr<RmRpcFSys> me, userver::HttpServer &htt
 		userver::QueryParser qp(vpath);
 		auto page = qp["page"];
 		auto format = qp["format"];
-		auto smooth = qp["smooth"].getUInt();
+		auto precision = qp["precision"];
+		auto coalesce = qp["coalesce"];
+		auto tolerance = qp["tolerance"];
+		auto grid = qp["grid"];
+		auto bbox = qp["bbox"];
+		auto scale = qp["scale"];
+		auto fields = qp["fields"];
 		auto id = vpathToFileID(qp.getPath());
 		if (id.empty()) return false;
-		LinesFormat fmt;
-		if (format == "json") fmt = LinesFormat::json;
-		else if (format == "svg") fmt = LinesFormat::svg;
-		else fmt = LinesFormat::raw;
-		return me->getLines(req, id, page.getUInt(), fmt, smooth);
+		LinesOptions opts;
+		if (format == "json") opts.fmt = LinesFormat::json;
+		else if (format == "svg") opts.fmt = LinesFormat::svg;
+		else if (format == "png") opts.fmt = LinesFormat::png;
+		else if (format == "bin") opts.fmt = LinesFormat::bin;
+		else opts.fmt = LinesFormat::raw;
+		opts.smooth = qp["smooth"].getUInt();
+		if (precision.defined) opts.precision = precision.getUInt();
+		if (coalesce.defined) {
+			double v = coalesce.getNumber();
+			if (!(v >= 0 && v <= max_coalesce)) {
+				req->sendErrorPage(400);
+				return true;
+			}
+			opts.coalesce = static_cast<float>(v);
+		}
+		if (tolerance.defined) opts.tolerance = static_cast<float>(tolerance.getNumber());
+		opts.compact = qp["profile"] == "compact";
+		if (grid.defined) {
+			double v = grid.getNumber();
+			if (!(v >= min_grid && v <= max_grid)) {
+				req->sendErrorPage(400);
+				return true;
+			}
+			opts.grid = static_cast<float>(v);
+		}
+		if (bbox.defined) {
+			if (!parseBox(bbox, opts.bbox)) {
+				req->sendErrorPage(400);
+				return true;
+			}
+			opts.clip = true;
+		}
+		if (fields.defined && !parseColumns(fields, opts.columns)) {
+			req->sendErrorPage(400);
+			return true;
+		}
+		opts.half = qp["encoding"] == "f16";
+		opts.columnar = qp["layout"] == "columnar";
+		if (scale.defined) opts.scale = static_cast<float>(scale.getNumber());
+		if (opts.fmt == LinesFormat::png) {
+			//same size as the rendered bitmap
+			Drawing::PngOptions pngopts;
+			pngopts.scale = opts.scale;
+			if (opts.clip) pngopts.viewport = opts.bbox;
+			unsigned int width, height;
+			if (!Drawing::bitmapSize(pngopts, max_png_pixels, width, height)) {
+				req->sendErrorPage(400);
+				return true;
+			}
+		}
+		return me->getLines(req, id, page.getUInt(), opts);
 
 	});
 }
 
-void RmRpcFSys::sendJSON(userver::PHttpServerRequest &req, json::Value json) {
-	req->setContentType("application/json");
-	userver::Stream s = req->send();
-	json.serialize([&](int c){s.putChar(c);});
+bool RmRpcFSys::parseColumns(std::string_view text, unsigned int &columns) {
+	static const std::pair<std::string_view, Drawing::Points::Column> names[] = {
+			{"x", Drawing::Points::col_x},
+			{"y", Drawing::Points::col_y},
+			{"speed", Drawing::Points::col_speed},
+			{"direction", Drawing::Points::col_direction},
+			{"width", Drawing::Points::col_width},
+			{"pressure", Drawing::Points::col_pressure}
+	};
+	columns = 0;
+	while (!text.empty()) {
+		auto sep = text.find(',');
+		auto item = text.substr(0, sep);
+		auto iter = std::find_if(std::begin(names), std::end(names), [&](const auto &n){return n.first == item;});
+		if (iter == std::end(names)) return false;
+		columns |= Drawing::Points::bit(iter->second);
+		text = sep == text.npos?std::string_view():text.substr(sep+1);
+	}
+	return true;
 }
 
-void RmRpcFSys::listFiles(userver::PHttpServerRequest &req) {
-	struct Info {
-		json::Value metadata;
-		std::vector<std::string> objects;
+bool RmRpcFSys::parseBox(std::string_view text, Drawing::Box &box) {
+	double v[4];
+	for (int i = 0; i < 4; i++) {
+		auto sep = text.find(',');
+		if ((sep == text.npos) != (i == 3)) return false;
+		std::string item(text.substr(0, sep));
+		char *end;
+		v[i] = std::strtod(item.c_str(), &end);
+		if (item.empty() || *end || !std::isfinite(v[i])) return false;
+		if (sep != text.npos) text = text.substr(sep+1);
+	}
+	if (v[2] <= 0 || v[3] <= 0) return false;
+	box = Drawing::Box{
+		static_cast<float>(v[0]),
+		static_cast<float>(v[1]),
+		static_cast<float>(v[0]+v[2]),
+		static_cast<float>(v[1]+v[3])
 	};
+	return true;
+}
+
+void RmRpcFSys::sendJSON(userver::PHttpServerRequest &req, json::Value json, ContentEncoding encoding) {
+	req->setContentType("application/json");
+	ResponseWriter wr(*req, stats, encoding, compression);
+	wr.serialize(json);
+	wr.finish();
+}
 
-	std::unordered_map<std::string, Info> files;
+ContentEncoding RmRpcFSys::chooseEncoding(userver::PHttpServerRequest &req) const {
+	if (compression.level <= 0) return ContentEncoding::identity;
+	req->set("Vary", "Accept-Encoding");
+	auto accept = req->get("Accept-Encoding");
+	return accept.defined?ResponseWriter::negotiate(accept):ContentEncoding::identity;
+}
 
+json::Value RmRpcFSys::getStats() const {
+	return json::Object
+			("responses", stats.toJSON())
+			("render_threads", pool.getThreads())
+			("lines_cache", cache.getStats())
+			("watched_dirs", watch?watch->getWatchCount():0)
+			("manifests", manifests.getStats())
+			("json_files", json_files.getStats())
+			("search", search_index.getStats());
+}
 
-	for (auto &p: std::filesystem::directory_iterator(root)) {
-		const std::filesystem::path &fpath = p;
-		auto name = fpath.stem().string();
-		auto ext = fpath.extension().string();
-		auto path = fpath.string();
+void RmRpcFSys::listFiles(userver::PHttpServerRequest &req) {
+	Catalog::Listing listing = catalog.getListing();
+	ContentEncoding enc = chooseEncoding(req);
+	Fingerprint fp;
+	fp.add("list");
+	fp.add(std::to_string(catalog.getInstance()));
+	fp.add(std::to_string(listing.generation));
+	fp.addTime(listing.last_modified);
+	fp.add(ResponseWriter::encodingName(enc));
+	if (notModified(req, fp, cache_control.list)) return;
+	if (sendCached(req, fp.getText())) return;
 
-		files[name].objects.push_back(ext);
+	req->setContentType("application/json");
+	ResponseWriter wr(*req, stats, enc, compression);
+	std::string body;
+	if (cache.enabled()) wr.capture(body, cache.maxEntrySize());
+	wr.append(*listing.json);
+	wr.finish();
+	storeCached(fp.getText(), "application/json", wr, std::move(body));
+}
 
-		if (ext == ".metadata") {
-			json::Value data = readJSON(fpath);
-			if (data.defined()) {
-				files[name].metadata = data;
-			}
-		}
-	}
-	sendJSON(req, json::Value(json::object, files.begin(), files.end(), [&](const auto &item) ->json::Value {
-		if (item.second.metadata.defined()) {
-			return json::Value(item.first, json::Object
-						("metadata",item.second.metadata)
-						("objects",json::Value(json::array,
-								item.second.objects.begin(),
-								item.second.objects.end(),[&](const std::string &x) -> json::Value{
-				return x;
-			})));
-		} else {
-			return json::Value();
-		}
-	}));
+bool RmRpcFSys::sendCached(userver::PHttpServerRequest &req, const std::string &key) {
+	auto e = cache.find(key);
+	if (!e) return false;
+	req->setContentType(e->content_type);
+	if (!e->content_encoding.empty()) req->set("Content-Encoding", e->content_encoding);
+	ResponseWriter wr(req->send(), stats);
+	wr.append(e->body);
+	wr.finish();
+	return true;
+}
 
+void RmRpcFSys::storeCached(const std::string &key, std::string_view content_type, const ResponseWriter &wr, std::string &&body) {
+	if (!wr.captured()) return;
+	ContentEncoding sent = wr.getEncoding();
+	cache.store(key, content_type,
+			sent == ContentEncoding::identity?std::string_view():ResponseWriter::encodingName(sent),
+			std::move(body));
 }
 
 json::Value RmRpcFSys::readJSON(const std::string &pathname) {
@@ -169,41 +310,98 @@ bool RmRpcFSys::serveFile(userver::PHttpServerRequest &req, std::string_view id,
 
 }
 
-bool RmRpcFSys::getThumb(userver::PHttpServerRequest &req, std::string_view id, json::Value content, unsigned long page) {
+bool RmRpcFSys::getThumb(userver::PHttpServerRequest &req, std::string_view id, const JSONFileCache::File &content, unsigned long page) {
 	auto thumb_path = root/id;
 	thumb_path.replace_extension(".thumbnails");
-	std::string thumbId = content["pages"][page].getString();
+	std::string_view thumbId = content.getPage(page);
+	if (thumbId.empty()) return false;
 	thumb_path = thumb_path / thumbId;
 	thumb_path.replace_extension(".jpg");
-	return req->sendFile(std::move(req), thumb_path.native());
+	std::optional<pdf::MappedFile> jpg;
+	try {
+		jpg.emplace(thumb_path.native());
+	} catch (const std::system_error &e) {
+		logDebug("Can't map file: $1 - error: $2", thumb_path.native(), e.what());
+		return false;
+	}
+	//validators describe the mapped data, not a file written meanwhile
+	Fingerprint fp;
+	fp.addStamp(static_cast<std::int64_t>(jpg->size()), jpg->getMTime());
+	if (notModified(req, fp, cache_control.thumb)) return true;
+	req->setContentType("image/jpeg");
+	ResponseWriter wr(req->send(), stats);
+	wr.append(*jpg);
+	wr.finish();
+	return true;
 }
 
 bool RmRpcFSys::getThumb(userver::PHttpServerRequest &req, std::string_view id, unsigned long page) {
 	auto content_path = root/id;
 	content_path.replace_extension(".content");
-	json::Value content = readJSON(content_path);
-	return getThumb(req, id, content, page);
+	auto content = json_files.get(content_path);
+	if (!content) return false;
+	return getThumb(req, id, *content, page);
 
 }
 
 bool RmRpcFSys::getThumb(userver::PHttpServerRequest &req, std::string_view id) {
 	auto metadata_path = root/id;
 	auto content_path = metadata_path;
-	auto thumb_path = metadata_path;
 	metadata_path.replace_extension(".metadata");
 	content_path.replace_extension(".content");
-	thumb_path.replace_extension(".thumbnails");
 
-	json::Value content = readJSON(content_path);
-	json::Value metadata = readJSON(metadata_path);
-	auto cover = content["coverPageNumber"].getInt();
+	auto content = json_files.get(content_path);
+	if (!content) return false;
+	auto cover = content->value["coverPageNumber"].getInt();
 	if (cover < 0) {
-		cover = metadata["lastOpenedPage"].getInt();
+		auto metadata = json_files.get(metadata_path);
+		cover = metadata?metadata->value["lastOpenedPage"].getInt():0;
 	}
-	return getThumb(req, id, content, cover);
+	return getThumb(req, id, *content, cover);
 }
 
 bool RmRpcFSys::getFileInfo(userver::PHttpServerRequest &req, std::string_view id) {
+	std::string sid(id);
+	std::string src_fingerprint;
+	std::time_t src_modified;
+	//the manifest is built only when the response is needed, a miss is validated by stat only
+	auto m = manifests.find(sid);
+	if (m) {
+		src_fingerprint = m->fingerprint;
+		src_modified = m->last_modified;
+	} else {
+		auto content_path = root/sid;
+		content_path.replace_extension(".content");
+		if (!std::filesystem::exists(content_path)) return false;
+		Fingerprint src = manifestFingerprint(sid);
+		src_fingerprint = src.getText();
+		src_modified = src.getLastModified();
+	}
+	ContentEncoding enc = chooseEncoding(req);
+	Fingerprint fp;
+	fp.add(src_fingerprint);
+	fp.addTime(src_modified);
+	fp.add(ResponseWriter::encodingName(enc));
+	if (notModified(req, fp, cache_control.info)) return true;
+	//files are stat before they are read, so the content is not older than the validators
+	if (!m) m = manifests.get(sid, [this](const std::string &id){return buildManifest(id);});
+	if (!m) return false;
+	sendJSON(req, m->info, enc);
+	return true;
+}
+
+RmRpcFSys::Fingerprint RmRpcFSys::manifestFingerprint(const std::string &id) const {
+	auto path = root/id;
+	Fingerprint fp;
+	fp.addFile(path.replace_extension(".content"));
+	fp.addFile(path.replace_extension(".metadata"));
+	fp.addDirectory(path.replace_extension());
+	fp.addDirectory(path.replace_extension(".thumbnails"));
+	fp.addDirectory(path.replace_extension(".textconversion"));
+	return fp;
+}
+
+ManifestCache::PManifest RmRpcFSys::buildManifest(const std::string &id) {
 	auto content_path = root/id;
 	auto metadata_path = root/id;
 	auto lines_path = content_path;
@@ -213,17 +411,19 @@ bool RmRpcFSys::getFileInfo(userver::PHttpServerRequest &req, std::string_view i
 	metadata_path.replace_extension(".metadata");
 	conv_path.replace_extension(".textconversion");
 	thumb_path.replace_extension(".thumbnails");
-	json::Value content = readJSON(content_path);
-	if (!content.defined()) return false;
+	if (!std::filesystem::exists(content_path)) return nullptr;
+	Fingerprint fp = manifestFingerprint(id);
+	auto content = json_files.get(content_path);
+	if (!content) return nullptr;
 	std::unordered_map<std::string, long> pages;
 	{
 		long p = 0;
-		for (json::Value v: content["pages"]) pages[v.getString()] = p++;
+		for (const std::string &pg: content->pages) pages[pg] = p++;
 	}
 	json::Object result;
-	result.set("content",content.replace("pages",json::undefined));
-	json::Value metadata = readJSON(metadata_path);
-	result.set("metadata",metadata);
+	result.set("content",content->value.replace("pages",json::undefined));
+	auto metadata = json_files.get(metadata_path);
+	result.set("metadata",metadata?metadata->value:json::Value());
 	try {
 	std::filesystem::directory_iterator diriter(lines_path);
 	result.set("drawings",json::Value(json::array,std::filesystem::begin(diriter), std::filesystem::end(diriter), [&](const std::filesystem::directory_entry &entry){
@@ -282,70 +482,331 @@ bool RmRpcFSys::getFileInfo(userver::PHttpServerRequest &req, std::string_view i
 	}));
 	} catch (...) {}
 
-	sendJSON(req, result);
-	return true;
+	auto m = std::make_shared<ManifestCache::Manifest>();
+	m->info = result;
+	m->fingerprint = fp.getText();
+	m->last_modified = fp.getLastModified();
+	return m;
 }
 
-bool RmRpcFSys::getLines(userver::PHttpServerRequest &req, std::string_view id, unsigned long page, LinesFormat fmt, int smooth) {
+void RmRpcFSys::search(json::RpcRequest req) {
+	json::Value args = req.getArgs();
+	json::Value query = args["query"];
+	if (query.type() != json::string) {
+		req.setError(-32602, "Invalid params", "Expected {\"query\": string, \"offset\": number, \"limit\": number}");
+		return;
+	}
+	std::size_t offset = args["offset"].getUInt();
+	json::Value limit = args["limit"];
+	std::size_t count = limit.defined()?std::min<std::size_t>(limit.getUInt(), max_search_limit):default_search_limit;
+	std::size_t total;
+	auto results = search_index.search(query.getString(), offset, count, total);
+	req.setResult(json::Object
+			("total", total)
+			("offset", offset)
+			//false while the index is being built
+			("complete", search_index.isReady())
+			("results", json::Value(json::array, results.begin(), results.end(), [&](const SearchIndex::Result &r){
+		//the index contains identifiers of the pages, numbers are taken from the current .content
+		auto content = json_files.get(root / (r.document + ".content"));
+		bool title = false;
+		json::Value pages(json::array, r.pages.begin(), r.pages.end(), [&](const SearchIndex::Page &pg){
+			if (pg.id.empty()) {
+				title = true;
+				return json::Value(json::undefined);
+			}
+			if (!content) return json::Value(json::undefined);
+			auto iter = std::find(content->pages.begin(), content->pages.end(), pg.id);
+			if (iter == content->pages.end()) return json::Value(json::undefined);
+			return json::Value(json::Object
+					("page", static_cast<unsigned long>(iter - content->pages.begin()))
+					("score", pg.score)
+					("positions", json::Value(json::array, pg.positions.begin(), pg.positions.end(), [](std::uint32_t pos){
+						return json::Value(pos);
+					})));
+		});
+		return json::Value(json::Object
+				("id", r.document)
+				("name", r.name)
+				("score", r.score)
+				("title", title)
+				("pages", pages));
+	})));
+}
+
+bool RmRpcFSys::getLines(userver::PHttpServerRequest &req, std::string_view id, unsigned long page, const LinesOptions &opts) {
 	auto content_path = root/id;
 	content_path.replace_extension(".content");
-	json::Value content = readJSON(content_path);
+	auto content = json_files.get(content_path);
+	if (!content) return false;
+	std::string_view pageId = content->getPage(page);
+	if (pageId.empty()) return false;
 	auto lines_path = root/id;
-	std::string thumbId = content["pages"][page].getString();
-	lines_path = lines_path / thumbId;
+	lines_path = lines_path / pageId;
 	lines_path.replace_extension(".rm");
 
-	if (fmt == LinesFormat::raw) {
-		return req->sendFile(std::move(req), lines_path.native());
+	std::optional<pdf::MappedFile> rmf;
+	try {
+		rmf.emplace(lines_path.native());
+	} catch (const std::system_error &e) {
+		logDebug("Can't map file: $1 - error: $2", lines_path.native(), e.what());
+		return false;
+	}
+
+	//the fingerprint is also the key of the cache
+	//PNG is already compressed, raw data are sent as file
+	ContentEncoding enc = opts.fmt == LinesFormat::png || opts.fmt == LinesFormat::raw
+			?ContentEncoding::identity:chooseEncoding(req);
+	Fingerprint fp = linesFingerprint(id, page, opts, *content, *rmf, lines_path);
+	fp.add(ResponseWriter::encodingName(enc));
+	if (notModified(req, fp, cache_control.lines)) return true;
+
+	if (opts.fmt == LinesFormat::raw) {
+		req->setContentType("application/octet-stream");
+		ResponseWriter wr(req->send(), stats);
+		wr.append(*rmf);
+		wr.finish();
+		return true;
 	} else {
 
-		std::ifstream rmf(lines_path.native());
-		if (!rmf) return false;
-		Drawing drw;
-		drw.load_rm(rmf);
-		if (smooth) drw.smooth(smooth);
-		if (fmt == LinesFormat::json) {
-			auto out = drw.toJSON();
-			sendJSON(req, out);
+		if (sendCached(req, fp.getText())) return true;
+
+		//the drawing is materialized only when it needs to be modified or when it is
+		//large enough to be rendered in parallel. Otherwise it is rendered in single pass
+		//the drawing is reused by the thread, so its buffers are allocated only once
+		static thread_local Drawing drw;
+		bool materialize = opts.smooth || opts.tolerance > 0 || opts.clip || opts.fmt == LinesFormat::png
+				|| (opts.fmt == LinesFormat::svg && pool.getThreads() > 1 && rmf->size() >= parallel_render_size);
+		if (materialize) {
+			drw.load_rm(*rmf);
+			//smoothing and simplification don't extend the bounds, so the lines can be clipped first
+			if (opts.clip) drw.clip(opts.bbox);
+			if (opts.smooth) drw.smooth(opts.smooth, opts.fmt == LinesFormat::svg?Drawing::Points::svg_columns:Drawing::Points::all_columns, &pool);
+			if (opts.tolerance > 0) drw.simplify(opts.tolerance, &pool);
 		} else {
-			auto mdata_path = lines_path.parent_path() / (lines_path.stem().string()+"-metadata.json");
-			json::Value layers = readJSON(mdata_path)["layers"];
-			Drawing::ColorDef colorDef;
-			std::string color_name;
-			int lrpos = 1;
-			for (json::Value lr: layers) {
-				auto name = lr["name"].getString();
-				auto colorpos = name.indexOf("/");
-				if (colorpos != name.npos) {
-					auto color = name.substr(colorpos+1);
-					for (char c: color) {
-						if (isspace(c)) break;
-						color_name.push_back(c);
-					}
-					if (!color_name.empty()) {
-						CSSColor baseColor(color_name);
-						CSSColor white("#FFFFFF");
-						white.a = baseColor.a;
-						CSSColor mixed = baseColor.mix(white);
-						colorDef.layerColors.push_back({lrpos,{
-							std::string(baseColor.getCSSColor()),
-							std::string(mixed.getCSSColor()),
-							std::string(white.getCSSColor()),
-							0
-						}});
-						color_name.clear();
-					}
-				}
-				lrpos++;
-			}
+			//validate before response is started
+			Drawing::check_rm(*rmf);
+		}
 
-			colorDef.prepare();
-			req->setContentTypeFromExt("svg");
-			userver::Stream s = req->send();
-			ondra_shared::ostream out([&](char c){s.putChar(c);});
-			drw.render_svg(out, colorDef);
-			s.flush();
+		std::string_view content_type;
+		switch (opts.fmt) {
+			case LinesFormat::json: content_type = "application/json";break;
+			case LinesFormat::bin: content_type = "application/octet-stream";break;
+			case LinesFormat::png: content_type = "image/png";break;
+			default: content_type = "image/svg+xml";break;
+		}
+		req->setContentType(content_type);
+		ResponseWriter wr(*req, stats, enc, compression);
+		//copy of the body (compressed) is collected for the cache
+		std::string body;
+		if (cache.enabled()) wr.capture(body, cache.maxEntrySize());
+		std::ostream out(&wr);
+
+		if (opts.fmt == LinesFormat::json) {
+			NumFormat num(opts.precision < 0?Drawing::json_decimals:opts.precision);
+			if (materialize) {
+				drw.write_json(out, num, opts.columnar);
+			} else {
+				Drawing::JsonWriter writer(out, num, opts.columnar);
+				Drawing::parse_rm(*rmf, writer);
+			}
+		} else if (opts.fmt == LinesFormat::bin) {
+			Drawing::BinOptions binopts;
+			binopts.columns = opts.columns;
+			binopts.half = opts.half;
+			if (opts.precision >= 0) binopts.decimals = opts.precision;
+			if (materialize) {
+				drw.write_bin(out, binopts);
+			} else {
+				Drawing::BinWriter writer(out, binopts);
+				Drawing::parse_rm(*rmf, writer);
+			}
+		} else if (opts.fmt == LinesFormat::png) {
+			Drawing::ColorDef colorDef = loadColorDef(lines_path);
+			Drawing::PngOptions pngopts;
+			pngopts.scale = opts.scale;
+			if (opts.clip) pngopts.viewport = opts.bbox;
+			drw.render_png(out, colorDef, pngopts, &pool);
+		} else {
+			Drawing::ColorDef colorDef = loadColorDef(lines_path);
+			Drawing::SvgOptions svgopts;
+			if (opts.precision >= 0) svgopts.num = NumFormat(opts.precision);
+			if (opts.coalesce >= 0) svgopts.coalesce = opts.coalesce;
+			svgopts.compact = opts.compact;
+			if (opts.clip) svgopts.viewport = opts.bbox;
+			if (opts.grid > 0) svgopts.grid = opts.grid;
+			if (materialize) {
+				drw.render_svg(out, colorDef, svgopts, &pool);
+			} else {
+				Drawing::SvgRenderer renderer(out, colorDef, svgopts);
+				Drawing::parse_rm(*rmf, renderer);
+			}
 		}
+		wr.finish();
+		storeCached(fp.getText(), content_type, wr, std::move(body));
 		return true;
 	}
 }
+
+std::filesystem::path RmRpcFSys::metadataPath(const std::filesystem::path &lines_path) {
+	return lines_path.parent_path() / (lines_path.stem().string()+"-metadata.json");
+}
+
+void RmRpcFSys::Fingerprint::add(std::string_view data) {
+	text.append(data);
+	text.push_back(';');
+}
+
+void RmRpcFSys::Fingerprint::addFile(const std::filesystem::path &path) {
+	struct stat st;
+	if (::stat(path.c_str(), &st)) {
+		text.append("-;");
+		return;
+	}
+	addStamp(st.st_size, static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+}
+
+void RmRpcFSys::Fingerprint::addStamp(std::int64_t size, std::int64_t mtime) {
+	std::time_t sec = static_cast<std::time_t>(mtime / 1000000000);
+	text.append(std::to_string(size)).push_back(':');
+	text.append(std::to_string(sec)).push_back('.');
+	text.append(std::to_string(mtime % 1000000000)).push_back(';');
+	last_modified = std::max(last_modified, sec);
+}
+
+void RmRpcFSys::Fingerprint::addDirectory(const std::filesystem::path &path) {
+	addFile(path);
+	std::vector<std::filesystem::path> entries;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator iter(path, ec), end; !ec && iter != end; iter.increment(ec)) {
+		entries.push_back(iter->path());
+	}
+	std::sort(entries.begin(), entries.end());
+	for (const auto &e: entries) {
+		add(e.filename().native());
+		addFile(e);
+	}
+}
+
+std::string RmRpcFSys::Fingerprint::getETag() const {
+	//FNV-1a
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (char c: text) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ULL;
+	}
+	char buff[20];
+	std::snprintf(buff, sizeof(buff), "\"%016llx\"", static_cast<unsigned long long>(hash));
+	return buff;
+}
+
+bool RmRpcFSys::matchETag(std::string_view if_none_match, std::string_view etag) {
+	while (!if_none_match.empty()) {
+		auto sep = if_none_match.find(',');
+		auto item = if_none_match.substr(0, sep);
+		while (!item.empty() && std::isspace(static_cast<unsigned char>(item.front()))) item = item.substr(1);
+		while (!item.empty() && std::isspace(static_cast<unsigned char>(item.back()))) item = item.substr(0, item.size()-1);
+		//weak comparison is used for GET
+		if (item.substr(0,2) == "W/") item = item.substr(2);
+		if (item == "*" || item == etag) return true;
+		if_none_match = sep == if_none_match.npos?std::string_view():if_none_match.substr(sep+1);
+	}
+	return false;
+}
+
+bool RmRpcFSys::notModified(userver::PHttpServerRequest &req, const Fingerprint &fp, const std::string &cache_control) {
+	std::string etag = fp.getETag();
+	req->set("ETag", etag);
+	if (!cache_control.empty()) req->set("Cache-Control", cache_control);
+	std::time_t lm = fp.getLastModified();
+	if (lm) {
+		char buff[64];
+		struct tm t;
+		gmtime_r(&lm, &t);
+		std::strftime(buff, sizeof(buff), "%a, %d %b %Y %H:%M:%S GMT", &t);
+		req->set("Last-Modified", buff);
+	}
+	bool not_modified = false;
+	auto inm = req->get("If-None-Match");
+	if (inm.defined) {
+		//If-Modified-Since is ignored when If-None-Match is present
+		not_modified = matchETag(inm, etag);
+	} else {
+		auto ims = req->get("If-Modified-Since");
+		if (ims.defined && lm) {
+			std::string date(ims);
+			struct tm t = {};
+			const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &t);
+			not_modified = end && !*end && lm <= timegm(&t);
+		}
+	}
+	if (not_modified) {
+		req->setStatus(304);
+		req->send(std::string_view());
+	}
+	return not_modified;
+}
+
+RmRpcFSys::Fingerprint RmRpcFSys::linesFingerprint(std::string_view id, unsigned long page, const LinesOptions &opts,
+		const JSONFileCache::File &content, const pdf::MappedFile &rmf, const std::filesystem::path &lines_path) {
+	std::ostringstream key;
+	//floats are written exactly
+	key << std::hexfloat;
+	key << id << '/' << page << ';'
+		<< static_cast<int>(opts.fmt) << ';'
+		<< opts.smooth << ';'
+		<< opts.tolerance << ';'
+		<< opts.precision << ';'
+		<< opts.coalesce << ';'
+		<< opts.compact << ';'
+		<< opts.grid << ';'
+		<< opts.clip << ';'
+		<< opts.bbox.left << ',' << opts.bbox.top << ',' << opts.bbox.right << ',' << opts.bbox.bottom << ';'
+		<< opts.scale << ';'
+		<< opts.columns << ';'
+		<< opts.half << ';'
+		<< opts.columnar;
+	Fingerprint fp;
+	fp.add(key.str());
+	//the response is valid, until any of the source files is changed
+	fp.addStamp(content.size, content.mtime);
+	fp.addStamp(static_cast<std::int64_t>(rmf.size()), rmf.getMTime());
+	//the page metadata are read after the fingerprint is made
+	fp.addFile(metadataPath(lines_path));
+	return fp;
+}
+
+Drawing::ColorDef RmRpcFSys::loadColorDef(const std::filesystem::path &lines_path) {
+	json::Value layers = readJSON(metadataPath(lines_path))["layers"];
+	Drawing::ColorDef colorDef;
+	std::string color_name;
+	int lrpos = 1;
+	for (json::Value lr: layers) {
+		auto name = lr["name"].getString();
+		auto colorpos = name.indexOf("/");
+		if (colorpos != name.npos) {
+			auto color = name.substr(colorpos+1);
+			for (char c: color) {
+				if (isspace(c)) break;
+				color_name.push_back(c);
+			}
+			if (!color_name.empty()) {
+				CSSColor baseColor(color_name);
+				CSSColor white("#FFFFFF");
+				white.a = baseColor.a;
+				CSSColor mixed = baseColor.mix(white);
+				colorDef.layerColors.push_back({lrpos,{
+					std::string(baseColor.getCSSColor()),
+					std::string(mixed.getCSSColor()),
+					std::string(white.getCSSColor()),
+					0
+				}});
+				color_name.clear();
+			}
+		}
+		lrpos++;
+	}
+
+	colorDef.prepare();
+	return colorDef;
+}
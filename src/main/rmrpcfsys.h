@@ -7,42 +7,220 @@
 
 #ifndef SRC_MAIN_RMRPCFSYS_H_
 #define SRC_MAIN_RMRPCFSYS_H_
+#include <ctime>
 #include <string_view>
 #include <shared/filesystem.h>
 #include <imtjson/rpc.h>
+#include <pdf/mapped_file.h>
 #include <userver/http_server.h>
+#include "catalog.h"
+#include "fs_watch.h"
+#include "json_file_cache.h"
+#include "manifest_cache.h"
+#include "response_cache.h"
+#include "response_writer.h"
+#include "rmparser.h"
+#include "search_index.h"
+#include "worker_pool.h"
 
 class RmRpcFSys {
 public:
-	RmRpcFSys(const std::string_view &rootPath);
+	///Construct object
+	/**
+	 * @param rootPath path to the data
+	 * @param render_threads count of threads used to process large pages. Set 0 to use
+	 * all CPU cores, set 1 to disable parallel processing
+	 * @param cache_size memory used to cache responses of the /lines request (bytes),
+	 * set 0 to disable the cache
+	 * @param catalog_snapshot path to the snapshot of the catalog, empty - not used
+	 */
+	RmRpcFSys(const std::string_view &rootPath, unsigned int render_threads = 0, std::size_t cache_size = 0,
+			const std::string &catalog_snapshot = std::string());
 
 	static void initRpc(std::shared_ptr<RmRpcFSys> me, json::RpcServer &rpc);
 	static void initHttp(std::shared_ptr<RmRpcFSys> me, userver::HttpServer &http);
 
+	///Returns statistics (for the /stats page)
+	json::Value getStats() const;
+
 
 
 
 	enum class LinesFormat {
 		raw,
 		json,
-		svg
+		svg,
+		png,
+		bin
+	};
+
+	///Options of the /lines request
+	struct LinesOptions {
+		LinesFormat fmt = LinesFormat::raw;
+		///count of smoothing passes
+		unsigned int smooth = 0;
+		///tolerance of the line simplification, 0 - disabled
+		float tolerance = 0;
+		///count of decimal places of numbers, -1 - default of the format
+		int precision = -1;
+		///tolerance of merging brush segments (SVG), negative - default
+		float coalesce = -1;
+		///compact paths (SVG)
+		bool compact = false;
+		///grid of compact paths, 0 - default
+		float grid = 0;
+		///render only lines, which intersect the bbox
+		bool clip = false;
+		Drawing::Box bbox = {0,0,Drawing::page_width,Drawing::page_height};
+		///scale of the bitmap (PNG)
+		float scale = 1;
+		///mask of columns (binary format, see Drawing::Points::bit)
+		unsigned int columns = Drawing::Points::svg_columns;
+		///float16 values (binary format)
+		bool half = false;
+		///columnar layout (JSON)
+		bool columnar = false;
+	};
+
+	///Cache-Control header of the responses of the endpoints, empty - not sent
+	struct CacheControl {
+		std::string lines = "no-cache";
+		std::string info = "no-cache";
+		std::string list = "no-cache";
+		std::string thumb = "no-cache";
+	};
+
+	void setCacheControl(const CacheControl &cc) {cache_control = cc;}
+	///Sets compression of the dynamic responses (/lines, /info, /list)
+	void setCompression(const CompressionConfig &cfg) {compression = cfg;}
+
+	///Fingerprint of the response
+	/**
+	 * Contains options of the request and size and time of modification of the
+	 * source files. It is used to generate validators (ETag, Last-Modified)
+	 */
+	class Fingerprint {
+	public:
+		///Adds data (for example options of the request)
+		void add(std::string_view data);
+		///Adds size and time of modification of the file, missing file is also recorded
+		void addFile(const std::filesystem::path &path);
+		///Adds size and time of modification (ns) of the file, which has been already read
+		void addStamp(std::int64_t size, std::int64_t mtime);
+		///Adds the directory and names, sizes and times of modification of its entries
+		void addDirectory(const std::filesystem::path &path);
+		///Returns text of the fingerprint
+		const std::string &getText() const {return text;}
+		///Returns strong ETag (including the quotes)
+		std::string getETag() const;
+		///Records time of modification of a source, which is not added as a file
+		void addTime(std::time_t t) {if (t > last_modified) last_modified = t;}
+		///Returns time of the newest file (seconds since epoch)
+		std::time_t getLastModified() const {return last_modified;}
+	protected:
+		std::string text;
+		std::time_t last_modified = 0;
 	};
 
 protected:
 	std::filesystem::path root;
+	///threads used to process large pages
+	WorkerPool pool;
+	///minimal size of .rm file to render SVG in parallel
+	static constexpr std::size_t parallel_render_size = 256*1024;
+	///maximal tolerance of merging brush segments (SVG)
+	static constexpr double max_coalesce = 10;
+	///range of the grid of compact paths (SVG), smaller grid would overflow the rounded coordinates
+	static constexpr double min_grid = 1e-3;
+	static constexpr double max_grid = 1e4;
+	///maximal count of pixels of the PNG image
+	static constexpr std::size_t max_png_pixels = 16*1024*1024;
+	///statistics of generated responses
+	ResponseStats stats;
+	///rendered responses of the /lines request
+	ResponseCache cache;
+	CacheControl cache_control;
+	CompressionConfig compression;
+	///watch of the root directory shared by the catalog, the manifests and the index, can be nullptr
+	std::unique_ptr<FsWatch> watch;
+	///documents in the root directory
+	Catalog catalog;
+	///manifests of the documents (/info)
+	ManifestCache manifests;
+	///parsed .content and .metadata files
+	JSONFileCache json_files;
+	///full-text index of the text conversions
+	SearchIndex search_index;
+	///count of results of the search method, when limit is not specified
+	static constexpr std::size_t default_search_limit = 20;
+	static constexpr std::size_t max_search_limit = 100;
 
 	static std::string_view vpathToFileID(std::string_view vpath);
+	///Creates watch, returns nullptr when inotify is not available
+	static std::unique_ptr<FsWatch> createWatch();
+	///Parses box in format x,y,w,h
+	/**
+	 * @return false, when format is invalid or box is empty
+	 */
+	static bool parseBox(std::string_view text, Drawing::Box &box);
+	///Parses comma separated list of columns (x,y,speed,direction,width,pressure)
+	/**
+	 * @return false, when unknown column is found
+	 */
+	static bool parseColumns(std::string_view text, unsigned int &columns);
 
 	bool serveFile(userver::PHttpServerRequest &req, std::string_view id, std::string_view ext, std::string_view ctx);
 	bool getThumb(userver::PHttpServerRequest &req, std::string_view id);
 	bool getThumb(userver::PHttpServerRequest &req, std::string_view id, unsigned long page);
-	bool getThumb(userver::PHttpServerRequest &req, std::string_view id, json::Value content, unsigned long page);
+	bool getThumb(userver::PHttpServerRequest &req, std::string_view id, const JSONFileCache::File &content, unsigned long page);
 	static json::Value readJSON(const std::string &pathname);
-	void sendJSON(userver::PHttpServerRequest &req, json::Value json);
+	void sendJSON(userver::PHttpServerRequest &req, json::Value json, ContentEncoding encoding = ContentEncoding::identity);
+	///Sends response from the cache
+	/**
+	 * @retval true response has been sent
+	 * @retval false not found (or cache is disabled)
+	 */
+	bool sendCached(userver::PHttpServerRequest &req, const std::string &key);
+	///Stores response captured by the writer to the cache
+	void storeCached(const std::string &key, std::string_view content_type, const ResponseWriter &wr, std::string &&body);
+	///Chooses content coding of the response from the request, sets header Vary
+	ContentEncoding chooseEncoding(userver::PHttpServerRequest &req) const;
 
 	void listFiles(userver::PHttpServerRequest &req);
 	bool getFileInfo(userver::PHttpServerRequest &req, std::string_view id);
-	bool getLines(userver::PHttpServerRequest &req, std::string_view id, unsigned long page, LinesFormat fmt, int smooth);
+	///Reads files of the document and builds its manifest, returns nullptr when document doesn't exist
+	ManifestCache::PManifest buildManifest(const std::string &id);
+	///Fingerprint of the source files of the manifest, files are only stat, not read
+	Fingerprint manifestFingerprint(const std::string &id) const;
+	///RPC method search
+	/**
+	 * params: {"query": string, "offset": number, "limit": number}
+	 *
+	 * result: {"total": number, "offset": number, "complete": bool, "results": [{"id", "name",
+	 * "score", "title": bool, "pages":[{"page", "score", "positions":[...]}]}]}
+	 */
+	void search(json::RpcRequest req);
+	bool getLines(userver::PHttpServerRequest &req, std::string_view id, unsigned long page, const LinesOptions &opts);
+	///Builds fingerprint of the /lines response (key of the cache and ETag)
+	/**
+	 * Stamps of the .content and .rm are taken from the data being used, so the
+	 * fingerprint can't describe newer files than the response
+	 */
+	static Fingerprint linesFingerprint(std::string_view id, unsigned long page, const LinesOptions &opts,
+			const JSONFileCache::File &content, const pdf::MappedFile &rmf, const std::filesystem::path &lines_path);
+	///Sets validators and Cache-Control of the response, handles conditional request
+	/**
+	 * @param req request
+	 * @param fp fingerprint of the response
+	 * @param cache_control value of the Cache-Control header, empty - not sent
+	 * @retval true response is not modified, status 304 has been sent
+	 * @retval false response must be sent
+	 */
+	static bool notModified(userver::PHttpServerRequest &req, const Fingerprint &fp, const std::string &cache_control);
+	static bool matchETag(std::string_view if_none_match, std::string_view etag);
+	static std::filesystem::path metadataPath(const std::filesystem::path &lines_path);
+	///Loads layer colors from the page's metadata
+	static Drawing::ColorDef loadColorDef(const std::filesystem::path &lines_path);
 };
 
 #endif /* SRC_MAIN_RMRPCFSYS_H_ */
@@ -0,0 +1,481 @@
+/*
+ * search_index.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "search_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <system_error>
+#include <sys/inotify.h>
+#include <imtjson/object.h>
+#include <shared/logOutput.h>
+
+using ondra_shared::logDebug;
+using ondra_shared::logError;
+using ondra_shared::logWarning;
+
+namespace {
+
+constexpr unsigned int root_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+		| IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+constexpr unsigned int pages_mask = IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+//longer words are truncated (bytes)
+constexpr std::size_t max_word_size = 64;
+constexpr char32_t invalid_char = 0xFFFD;
+
+const SearchIndex::Tokens no_tokens;
+
+char32_t decodeUTF8(std::string_view text, std::size_t &pos) {
+	unsigned char c = static_cast<unsigned char>(text[pos++]);
+	if (c < 0x80) return c;
+	int n;
+	char32_t cp;
+	if ((c & 0xE0) == 0xC0) {n = 1; cp = c & 0x1F;}
+	else if ((c & 0xF0) == 0xE0) {n = 2; cp = c & 0x0F;}
+	else if ((c & 0xF8) == 0xF0) {n = 3; cp = c & 0x07;}
+	else return invalid_char;
+	for (; n; --n) {
+		if (pos >= text.size()) return invalid_char;
+		unsigned char d = static_cast<unsigned char>(text[pos]);
+		if ((d & 0xC0) != 0x80) return invalid_char;
+		cp = (cp << 6) | (d & 0x3F);
+		++pos;
+	}
+	return cp;
+}
+
+void encodeUTF8(char32_t c, std::string &out) {
+	if (c < 0x80) {
+		out.push_back(static_cast<char>(c));
+	} else if (c < 0x800) {
+		out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+		out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+	} else if (c < 0x10000) {
+		out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+		out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+	} else {
+		out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+		out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+	}
+}
+
+bool isWordChar(char32_t c) {
+	if (c < 0x80) return std::isalnum(static_cast<int>(c)) != 0;
+	//Latin-1 punctuation and symbols, except ª µ º
+	if (c < 0xC0) return c == 0xAA || c == 0xB5 || c == 0xBA;
+	if (c == 0xD7 || c == 0xF7) return false;
+	//general punctuation, symbols, arrows, box drawing, ...
+	if (c >= 0x2000 && c <= 0x2BFF) return false;
+	//CJK punctuation
+	if (c >= 0x3000 && c <= 0x303F) return false;
+	return c != invalid_char;
+}
+
+//simple case folding of Latin, Greek and Cyrillic
+char32_t foldCase(char32_t c) {
+	if (c < 0x80) return c >= 'A' && c <= 'Z'?c + 0x20:c;
+	if (c >= 0xC0 && c <= 0xDE) return c + 0x20;
+	if (c >= 0x100 && c <= 0x137) return c | 1;
+	if (c >= 0x139 && c <= 0x148) return (c & 1)?c + 1:c;
+	if (c >= 0x14A && c <= 0x177) return c | 1;
+	if (c == 0x178) return 0xFF;
+	if (c >= 0x179 && c <= 0x17E) return (c & 1)?c + 1:c;
+	if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) return c + 0x20;
+	if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+	if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+	return c;
+}
+
+json::Value readJSON(const std::filesystem::path &path) {
+	std::ifstream in(path, std::ios::in);
+	if (!in) return json::undefined;
+	try {
+		return json::Value::fromStream(in);
+	} catch (const std::exception &e) {
+		logError("Parse error: $1 - error: $2", path.native(), e.what());
+		return json::undefined;
+	}
+}
+
+}
+
+SearchIndex::SearchIndex(const std::filesystem::path &root, FsWatch *watch):root(root),watch(watch) {
+	if (watch) {
+		//events which arrive during the build are held and applied after the build
+		subscriber = watch->subscribe([this](const FsWatch::Event &ev){onEvent(ev);}, false);
+		try {
+			root_wd = watch->add(subscriber, root.native(), root_mask);
+			live = true;
+		} catch (const std::exception &e) {
+			logError("SearchIndex: can't watch the directory, the index will not be updated: $1", e.what());
+		}
+	} else {
+		logError("SearchIndex: watch is not available, the index will not be updated");
+	}
+	loader = std::thread([this]{
+		try {
+			build();
+		} catch (const std::exception &e) {
+			logError("SearchIndex: build failed: $1", e.what());
+		}
+		ready = true;
+		if (this->watch) this->watch->activate(subscriber);
+		refreshUnwatched();
+	});
+}
+
+SearchIndex::~SearchIndex() {
+	{
+		std::lock_guard _(unwatched_mx);
+		stopping = true;
+	}
+	unwatched_cond.notify_all();
+	if (loader.joinable()) loader.join();
+	if (watch) watch->unsubscribe(subscriber);
+}
+
+void SearchIndex::tokenize(std::string_view text, Tokens &tokens) {
+	std::string word;
+	std::uint32_t position = 0;
+	auto flush = [&]{
+		if (!word.empty()) {
+			tokens[word].push_back(position++);
+			word.clear();
+		}
+	};
+	std::size_t pos = 0;
+	while (pos < text.size()) {
+		char32_t c = decodeUTF8(text, pos);
+		if (isWordChar(c)) {
+			if (word.size() < max_word_size) encodeUTF8(foldCase(c), word);
+		} else {
+			flush();
+		}
+	}
+	flush();
+}
+
+void SearchIndex::build() {
+	std::unordered_set<std::string> found;
+	for (const auto &entry: std::filesystem::directory_iterator(root)) {
+		std::string name = entry.path().filename().string();
+		auto dot = name.find('.');
+		if (dot == name.npos) continue;
+		std::string_view ext = std::string_view(name).substr(dot);
+		if (ext != ".metadata" && ext != ".textconversion") continue;
+		std::string id = name.substr(0, dot);
+		if (found.insert(id).second) indexDocument(id);
+	}
+	std::unique_lock _(mx);
+	for (auto iter = docs.begin(); iter != docs.end();) {
+		if (found.count(iter->first)) {
+			++iter;
+		} else {
+			//the document is erased with its last unit
+			std::string id = iter->first;
+			std::vector<std::string> pages;
+			for (const auto &pg: iter->second.pages) pages.push_back(pg.first);
+			++iter;
+			for (const auto &pg: pages) replaceUnit(id, pg, no_tokens);
+			replaceUnit(id, std::string(), no_tokens);
+			names.erase(id);
+		}
+	}
+}
+
+void SearchIndex::indexDocument(const std::string &id) {
+	indexName(id);
+	watchDocument(id);
+	indexPages(id);
+}
+
+void SearchIndex::indexName(const std::string &id) {
+	json::Value metadata = readJSON(root / (id + ".metadata"));
+	std::string name = metadata["visibleName"].getString();
+	Tokens tokens;
+	tokenize(name, tokens);
+	std::unique_lock _(mx);
+	replaceUnit(id, std::string(), tokens);
+	if (metadata.defined()) names[id] = name;
+	else names.erase(id);
+}
+
+void SearchIndex::indexPages(const std::string &id) {
+	std::unordered_set<std::string> found;
+	std::error_code ec;
+	for (const auto &entry: std::filesystem::directory_iterator(root / (id + ".textconversion"), ec)) {
+		const std::filesystem::path &path = entry.path();
+		if (path.extension().string() != ".json") continue;
+		std::string page = path.stem().string();
+		indexPage(id, page);
+		found.insert(page);
+	}
+	std::unique_lock _(mx);
+	auto iter = docs.find(id);
+	if (iter == docs.end()) return;
+	std::vector<std::string> removed;
+	for (const auto &pg: iter->second.pages) {
+		if (!found.count(pg.first)) removed.push_back(pg.first);
+	}
+	for (const auto &pg: removed) replaceUnit(id, pg, no_tokens);
+}
+
+void SearchIndex::indexPage(const std::string &id, const std::string &page) {
+	json::Value conv = readJSON(root / (id + ".textconversion") / (page + ".json"));
+	Tokens tokens;
+	tokenize(conv["text"].getString(), tokens);
+	std::unique_lock _(mx);
+	replaceUnit(id, page, tokens);
+}
+
+void SearchIndex::replaceUnit(const std::string &id, const std::string &page, const Tokens &tokens) {
+	auto diter = docs.find(id);
+	if (diter == docs.end()) {
+		if (tokens.empty()) return;
+		diter = docs.emplace(id, Document()).first;
+	}
+	Document &doc = diter->second;
+	auto piter = doc.pages.end();
+	std::uint32_t unit = no_unit;
+	if (page.empty()) {
+		unit = doc.title;
+	} else {
+		piter = doc.pages.find(page);
+		if (piter != doc.pages.end()) unit = piter->second;
+	}
+	if (unit != no_unit) clearUnit(unit);
+
+	if (tokens.empty()) {
+		if (unit != no_unit) {
+			units[unit].document.clear();
+			units[unit].page.clear();
+			free_units.push_back(unit);
+		}
+		if (page.empty()) doc.title = no_unit;
+		else if (piter != doc.pages.end()) doc.pages.erase(piter);
+		if (doc.title == no_unit && doc.pages.empty()) docs.erase(diter);
+		return;
+	}
+
+	if (unit == no_unit) {
+		if (free_units.empty()) {
+			unit = static_cast<std::uint32_t>(units.size());
+			units.emplace_back();
+		} else {
+			unit = free_units.back();
+			free_units.pop_back();
+		}
+		units[unit].document = id;
+		units[unit].page = page;
+		if (page.empty()) doc.title = unit;
+		else doc.pages.emplace(page, unit);
+	}
+	Unit &u = units[unit];
+	u.terms.reserve(tokens.size());
+	for (const auto &t: tokens) {
+		Postings &postings = terms[t.first];
+		auto pos = std::lower_bound(postings.begin(), postings.end(), unit, [](const Posting &p, std::uint32_t unit){
+			return p.unit < unit;
+		});
+		postings.insert(pos, Posting{unit, t.second});
+		u.terms.push_back(t.first);
+	}
+}
+
+void SearchIndex::clearUnit(std::uint32_t unit) {
+	for (const std::string &t: units[unit].terms) {
+		auto iter = terms.find(t);
+		if (iter == terms.end()) continue;
+		Postings &postings = iter->second;
+		auto pos = std::lower_bound(postings.begin(), postings.end(), unit, [](const Posting &p, std::uint32_t unit){
+			return p.unit < unit;
+		});
+		if (pos != postings.end() && pos->unit == unit) postings.erase(pos);
+		if (postings.empty()) terms.erase(iter);
+	}
+	units[unit].terms.clear();
+}
+
+void SearchIndex::watchDocument(const std::string &id) {
+	if (!live) return;
+	auto path = root / (id + ".textconversion");
+	bool ok = true;
+	try {
+		int wd = watch->add(subscriber, path.native(), pages_mask);
+		std::unique_lock _(mx);
+		watched[wd] = id;
+	} catch (const std::system_error &e) {
+		if (e.code().value() == ENOENT) {
+			//directory doesn't exist, its creation is reported by the watch of the root
+			logDebug("SearchIndex: can't watch $1: $2", path.native(), e.what());
+		} else {
+			logWarning("SearchIndex: can't watch $1, it will be indexed on search: $2", path.native(), e.what());
+			ok = false;
+		}
+	}
+	std::lock_guard _(unwatched_mx);
+	if (ok) unwatched.erase(id);
+	else if (unwatched.insert(id).second) unwatched_cond.notify_all();
+}
+
+void SearchIndex::refreshUnwatched() {
+	std::unique_lock lk(unwatched_mx);
+	for (;;) {
+		unwatched_cond.wait(lk, [&]{return stopping || !unwatched.empty();});
+		//changes of these documents are not reported, they are indexed after each interval
+		if (unwatched_cond.wait_for(lk, unwatched_interval, [&]{return stopping;})) return;
+		std::vector<std::string> ids(unwatched.begin(), unwatched.end());
+		lk.unlock();
+		for (const std::string &id: ids) {
+			watchDocument(id);
+			indexPages(id);
+		}
+		lk.lock();
+	}
+}
+
+void SearchIndex::onEvent(const FsWatch::Event &ev) {
+	constexpr unsigned int changed = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+	if (ev.mask & IN_Q_OVERFLOW) {
+		logWarning("SearchIndex: events have been lost, rebuilding the index");
+		build();
+	} else if (ev.wd == root_wd) {
+		if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+			logError("SearchIndex: directory has been removed: $1", root.native());
+			live = false;
+			return;
+		}
+		auto dot = ev.name.find('.');
+		if (dot == ev.name.npos) return;
+		std::string id(ev.name.substr(0, dot));
+		std::string_view ext = ev.name.substr(dot);
+		if (ext == ".metadata") {
+			//created file can be incomplete, it is indexed when it is closed
+			if (ev.mask & changed) indexName(id);
+		} else if (ext == ".textconversion") {
+			if (ev.mask & (IN_CREATE | IN_MOVED_TO)) watchDocument(id);
+			if (ev.mask & (IN_CREATE | changed)) indexPages(id);
+		}
+	} else {
+		std::string id;
+		{
+			std::unique_lock _(mx);
+			auto iter = watched.find(ev.wd);
+			if (iter == watched.end()) return;
+			//watch has been removed (the directory has been deleted)
+			if (ev.mask & IN_IGNORED) {
+				watched.erase(iter);
+				return;
+			}
+			id = iter->second;
+		}
+		std::filesystem::path name{std::string(ev.name)};
+		if (name.extension().string() != ".json") return;
+		if (ev.mask & changed) indexPage(id, name.stem().string());
+	}
+}
+
+std::vector<SearchIndex::Result> SearchIndex::search(std::string_view query, std::size_t offset, std::size_t limit, std::size_t &total) const {
+	std::vector<Result> results;
+	total = 0;
+	Tokens words;
+	tokenize(query, words);
+	if (words.empty()) return results;
+
+	std::shared_lock _(mx);
+	std::vector<const Postings *> lists;
+	lists.reserve(words.size());
+	for (const auto &w: words) {
+		auto iter = terms.find(w.first);
+		if (iter == terms.end()) return results;
+		lists.push_back(&iter->second);
+	}
+	//the rarest word is enumerated, the others are searched
+	std::sort(lists.begin(), lists.end(), [](const Postings *a, const Postings *b){
+		return a->size() < b->size();
+	});
+	double unit_count = static_cast<double>(units.size() - free_units.size());
+	std::vector<double> idf;
+	idf.reserve(lists.size());
+	for (const Postings *p: lists) idf.push_back(std::log(1.0 + unit_count / p->size()));
+
+	std::unordered_map<std::string_view, std::size_t> doc_index;
+	std::vector<std::uint32_t> positions;
+	for (const Posting &first: *lists[0]) {
+		double score = 0;
+		positions.clear();
+		bool match = true;
+		for (std::size_t i = 0; i < lists.size(); ++i) {
+			const Posting *p = &first;
+			if (i) {
+				auto pos = std::lower_bound(lists[i]->begin(), lists[i]->end(), first.unit, [](const Posting &p, std::uint32_t unit){
+					return p.unit < unit;
+				});
+				if (pos == lists[i]->end() || pos->unit != first.unit) {
+					match = false;
+					break;
+				}
+				p = &*pos;
+			}
+			score += (1.0 + std::log(static_cast<double>(p->positions.size()))) * idf[i];
+			positions.insert(positions.end(), p->positions.begin(), p->positions.end());
+		}
+		if (!match) continue;
+		const Unit &u = units[first.unit];
+		if (u.page.empty()) score *= 2;
+		std::sort(positions.begin(), positions.end());
+		auto ins = doc_index.emplace(u.document, results.size());
+		if (ins.second) {
+			Result r;
+			r.document = u.document;
+			auto n = names.find(u.document);
+			if (n != names.end()) r.name = n->second;
+			r.score = 0;
+			results.push_back(std::move(r));
+		}
+		Result &r = results[ins.first->second];
+		r.score += score;
+		r.pages.push_back(Page{u.page, positions, score});
+	}
+	_.unlock();
+
+	total = results.size();
+	auto order = [](const Result &a, const Result &b){
+		return a.score != b.score?a.score > b.score:a.document < b.document;
+	};
+	if (offset >= results.size()) {
+		results.clear();
+		return results;
+	}
+	std::size_t end = std::min(results.size(), offset + std::min(limit, results.size()));
+	std::partial_sort(results.begin(), results.begin() + end, results.end(), order);
+	results.erase(results.begin() + end, results.end());
+	results.erase(results.begin(), results.begin() + offset);
+	for (Result &r: results) {
+		std::sort(r.pages.begin(), r.pages.end(), [](const Page &a, const Page &b){
+			return a.score > b.score;
+		});
+	}
+	return results;
+}
+
+json::Value SearchIndex::getStats() const {
+	std::shared_lock _(mx);
+	return json::Object
+			("ready", isReady())
+			("live", live.load())
+			("documents", docs.size())
+			("units", units.size() - free_units.size())
+			("terms", terms.size());
+}
@@ -0,0 +1,165 @@
+/*
+ * search_index.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_SEARCH_INDEX_H_
+#define SRC_MAIN_SEARCH_INDEX_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <imtjson/value.h>
+#include <shared/filesystem.h>
+#include "fs_watch.h"
+
+///Full-text index of the text conversions and the names of the documents
+/**
+ * Each page of the text conversion (<id>.textconversion/<page>.json) and the
+ * name of the document (visibleName of <id>.metadata) is indexed as a unit.
+ * Words are case folded. The index is built in background at start and it
+ * is updated by watching the root directory and the text conversion directories.
+ * Documents, which can't be watched, are indexed periodically by the background
+ * thread
+ */
+class SearchIndex {
+public:
+	///Words of the text (folded) and their positions (index of the word)
+	using Tokens = std::unordered_map<std::string, std::vector<std::uint32_t> >;
+
+	struct Page {
+		///identifier of the page, empty for the name of the document
+		std::string id;
+		///positions of the found words, ordered
+		std::vector<std::uint32_t> positions;
+		double score;
+	};
+
+	struct Result {
+		std::string document;
+		///name of the document
+		std::string name;
+		double score;
+		///matching units, ordered by score
+		std::vector<Page> pages;
+	};
+
+	///Construct index, starts the build
+	/**
+	 * @param root root directory
+	 * @param watch shared watch, nullptr - not available, the index is not updated
+	 */
+	SearchIndex(const std::filesystem::path &root, FsWatch *watch);
+	~SearchIndex();
+
+	SearchIndex(const SearchIndex &) = delete;
+	SearchIndex &operator=(const SearchIndex &) = delete;
+
+	///Searches documents
+	/**
+	 * Unit matches, when it contains all words of the query. Documents are ranked by
+	 * sum of the scores of the matching units (tf-idf, name has double weight)
+	 *
+	 * @param query text of the query
+	 * @param offset count of the results to skip
+	 * @param limit max count of the results
+	 * @param total receives count of all results
+	 * @return results ordered by score
+	 */
+	std::vector<Result> search(std::string_view query, std::size_t offset, std::size_t limit, std::size_t &total) const;
+
+	///Returns true, when the initial build has been finished
+	bool isReady() const {return ready;}
+
+	json::Value getStats() const;
+
+	///Splits text to words, folds case of the words
+	static void tokenize(std::string_view text, Tokens &tokens);
+
+protected:
+	struct Posting {
+		std::uint32_t unit;
+		std::vector<std::uint32_t> positions;
+	};
+	//ordered by unit
+	using Postings = std::vector<Posting>;
+
+	struct Unit {
+		//document, empty - unit is not used
+		std::string document;
+		//page, empty - name of the document
+		std::string page;
+		//words of the unit
+		std::vector<std::string> terms;
+	};
+
+	struct Document {
+		std::uint32_t title = no_unit;
+		std::unordered_map<std::string, std::uint32_t> pages;
+	};
+
+	static constexpr std::uint32_t no_unit = ~std::uint32_t(0);
+
+	std::filesystem::path root;
+	mutable std::shared_mutex mx;
+	std::unordered_map<std::string, Postings> terms;
+	std::vector<Unit> units;
+	std::vector<std::uint32_t> free_units;
+	std::unordered_map<std::string, Document> docs;
+	//names of the documents
+	std::unordered_map<std::string, std::string> names;
+
+	//watched text conversion directories (watch descriptor -> id)
+	std::unordered_map<int, std::string> watched;
+	int root_wd = -1;
+	FsWatch *watch;
+	FsWatch::Subscriber subscriber = 0;
+	//documents, whose text conversions can't be watched (for example limit of watches
+	//has been reached)
+	std::mutex unwatched_mx;
+	std::unordered_set<std::string> unwatched;
+	//wakes the loader, when a document is unwatched or the index is destroyed
+	std::condition_variable unwatched_cond;
+	bool stopping = false;
+	//interval of indexing of the unwatched documents
+	static constexpr std::chrono::seconds unwatched_interval{1};
+	//builds the index, then indexes the unwatched documents
+	std::thread loader;
+	std::atomic<bool> ready = false;
+	std::atomic<bool> live = false;
+
+	///Indexes all documents, removes documents which no longer exist
+	void build();
+	///Indexes name and all pages of the document
+	void indexDocument(const std::string &id);
+	///Indexes name of the document
+	void indexName(const std::string &id);
+	///Indexes pages of the document, removes pages which no longer exist
+	void indexPages(const std::string &id);
+	///Indexes the page, removes it when it no longer exists
+	void indexPage(const std::string &id, const std::string &page);
+	///Replaces words of the unit, empty tokens - removes the unit (must be called under lock)
+	void replaceUnit(const std::string &id, const std::string &page, const Tokens &tokens);
+	///Removes words of the unit from the index (must be called under lock)
+	void clearUnit(std::uint32_t unit);
+	///Watches text conversions of the document, records unwatched documents
+	void watchDocument(const std::string &id);
+	///Indexes unwatched documents periodically and tries to watch them, until the index is destroyed
+	void refreshUnwatched();
+	void onEvent(const FsWatch::Event &ev);
+};
+
+#endif /* SRC_MAIN_SEARCH_INDEX_H_ */
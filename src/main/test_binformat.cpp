@@ -0,0 +1,224 @@
+/*
+ * test_binformat.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ *
+ *  Round trip test of the binary format - writes the page by write_bin,
+ *  decodes it by the reference decoder (parse_bin) and compares decoded
+ *  values with the source within precision of the mode (quantized delta,
+ *  float16). Decoded data must encode to the same bytes again
+ *
+ *  usage: test_binformat [file.rm ...]
+ *
+ *  Without arguments, only the generated page is tested
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "rmparser.h"
+
+namespace {
+
+///Records events of the visitor
+class Capture: public Drawing::Visitor {
+public:
+	struct LineData {
+		Drawing::Brush type;
+		Drawing::Color color;
+		float size;
+		std::vector<float> columns[Drawing::Points::column_count];
+	};
+
+	int version = 0;
+	std::vector<std::size_t> layers;
+	std::vector<LineData> lines;
+
+	virtual void begin_content(int version, std::size_t) override {
+		this->version = version;
+		layers.clear();
+		lines.clear();
+	}
+	virtual void begin_layer(std::size_t, std::size_t lines) override {
+		layers.push_back(lines);
+	}
+	virtual void end_line(const Drawing::Line &ln) override {
+		LineData ld{ln.type, ln.color, ln.size, {}};
+		for (int c = 0; c < Drawing::Points::column_count; c++) {
+			const float *col = ln.points.column(static_cast<Drawing::Points::Column>(c));
+			ld.columns[c].assign(col, col+ln.points.size());
+		}
+		lines.push_back(std::move(ld));
+	}
+};
+
+struct Mode {
+	const char *name;
+	unsigned int columns;
+	bool half;
+	int decimals;
+};
+
+const Mode modes[] = {
+		{"delta, svg columns, 2 decimals", Drawing::Points::svg_columns, false, 2},
+		{"delta, all columns, 0 decimals", Drawing::Points::all_columns, false, 0},
+		{"delta, all columns, 6 decimals", Drawing::Points::all_columns, false, 6},
+		{"float16, svg columns", Drawing::Points::svg_columns, true, 0},
+		{"float16, all columns", Drawing::Points::all_columns, true, 0},
+};
+
+//max error of the decoded value
+double tolerance(const Mode &mode, float v) {
+	double a = std::abs(static_cast<double>(v));
+	//half precision keeps 11 significant bits, subnormal step is 2^-24
+	if (mode.half) return std::max(a * std::ldexp(1.0, -11), std::ldexp(1.0, -25));
+	//rounding to the step and rounding of the decoded value to float
+	return 0.5 * std::pow(10.0, -mode.decimals) * 1.0001 + a * std::ldexp(1.0, -23);
+}
+
+std::string compare(const Capture &src, const Capture &dec, const Mode &mode) {
+	if (src.version != dec.version) return "version differs";
+	if (src.layers != dec.layers) return "count of layers or lines differs";
+	if (src.lines.size() != dec.lines.size()) return "count of lines differs";
+	for (std::size_t i = 0; i < src.lines.size(); i++) {
+		const Capture::LineData &a = src.lines[i];
+		const Capture::LineData &b = dec.lines[i];
+		std::string where = "line " + std::to_string(i) + ": ";
+		if (a.type != b.type || a.color != b.color) return where + "brush or color differs";
+		if (std::memcmp(&a.size, &b.size, sizeof(float))) return where + "size differs";
+		for (int c = 0; c < Drawing::Points::column_count; c++) {
+			const std::vector<float> &ca = a.columns[c];
+			const std::vector<float> &cb = b.columns[c];
+			if (ca.size() != cb.size()) return where + "count of points differs";
+			bool stored = (mode.columns & Drawing::Points::bit(static_cast<Drawing::Points::Column>(c))) != 0;
+			for (std::size_t k = 0; k < ca.size(); k++) {
+				float expect = stored?ca[k]:0.0f;
+				double err = std::abs(static_cast<double>(cb[k]) - static_cast<double>(expect));
+				if (!(err <= (stored?tolerance(mode, expect):0.0))) {
+					std::ostringstream msg;
+					msg << where << "column " << c << ", point " << k << ": " << cb[k] << ", expected " << expect;
+					return msg.str();
+				}
+			}
+		}
+	}
+	return std::string();
+}
+
+bool testPage(const std::string &name, const std::string &rm) {
+	Drawing drw;
+	drw.load_rm(std::string_view(rm));
+	Capture src;
+	drw.getContent().visit(src);
+
+	bool ok = true;
+	for (const Mode &mode: modes) {
+		Drawing::BinOptions opts;
+		opts.columns = mode.columns;
+		opts.half = mode.half;
+		opts.decimals = mode.decimals;
+		std::ostringstream out;
+		drw.write_bin(out, opts);
+		std::string data = out.str();
+
+		std::string err;
+		try {
+			Capture dec;
+			Drawing::parse_bin(data, dec);
+			err = compare(src, dec, mode);
+			if (err.empty()) {
+				//decoded values must be encoded exactly as before
+				std::ostringstream again;
+				Drawing::BinWriter writer(again, opts);
+				Drawing::parse_bin(data, writer);
+				if (again.str() != data) err = "encoding of the decoded data differs";
+			}
+		} catch (const std::exception &e) {
+			err = e.what();
+		}
+		std::cout << name << ", " << mode.name << ": " << data.size() << " bytes"
+				  << (err.empty()?"":" FAIL - ") << err << std::endl;
+		if (!err.empty()) ok = false;
+	}
+	return ok;
+}
+
+void putInt32(std::string &out, std::int32_t v) {
+	out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+void putFloat32(std::string &out, float v) {
+	out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+///Generates .rm page with random lines (version 5, little endian host)
+std::string generatePage() {
+	static const int brushes[] = {2, 3, 4, 6, 8, 12, 13, 14, 15, 16, 17, 18};
+	std::mt19937 rnd(1);
+	std::uniform_real_distribution<float> step(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::string out("reMarkable .lines file, version=5          ");
+	int layers = 3;
+	putInt32(out, layers);
+	for (int l = 0; l < layers; l++) {
+		int lines = 20 + l * 10;
+		putInt32(out, lines);
+		for (int i = 0; i < lines; i++) {
+			putInt32(out, brushes[rnd() % (sizeof(brushes)/sizeof(brushes[0]))]);
+			putInt32(out, static_cast<std::int32_t>(rnd() % 3));
+			putInt32(out, 0);
+			putFloat32(out, 1.0f + unit(rnd));
+			putInt32(out, 0);
+			//includes empty lines and single points
+			int cnt = i < 2?i:static_cast<int>(rnd() % 400);
+			putInt32(out, cnt);
+			//starts outside the page to get negative coordinates
+			float x = unit(rnd) * 1500.0f - 50.0f;
+			float y = unit(rnd) * 1950.0f - 50.0f;
+			for (int k = 0; k < cnt; k++) {
+				x += step(rnd);
+				y += step(rnd);
+				putFloat32(out, x);
+				putFloat32(out, y);
+				putFloat32(out, unit(rnd) * 50.0f);
+				//tiny values are subnormal in float16
+				putFloat32(out, k % 7?unit(rnd) * 6.2832f:unit(rnd) * 1e-5f);
+				putFloat32(out, unit(rnd) * 30.0f);
+				putFloat32(out, unit(rnd));
+			}
+		}
+	}
+	return out;
+}
+
+}
+
+int main(int argc, char **argv) {
+	bool ok = true;
+	try {
+		ok = testPage("generated", generatePage());
+		for (int i = 1; i < argc; i++) {
+			std::ifstream in(argv[i], std::ios::in|std::ios::binary);
+			if (!in) {
+				std::cerr << "Can't open file: " << argv[i] << std::endl;
+				return 2;
+			}
+			std::string rm((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			if (!testPage(argv[i], rm)) ok = false;
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "FAIL: " << e.what() << std::endl;
+		return 1;
+	}
+	return ok?0:1;
+}
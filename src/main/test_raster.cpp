@@ -0,0 +1,123 @@
+/*
+ * test_raster.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ *
+ *  Golden image test of the rasterizer - renders the .rm file and compares
+ *  the bitmap with the reference image (gzipped binary PPM). The page is
+ *  rendered serially and in parallel, both results must be identical
+ *
+ *  usage: test_raster <file.rm> <golden.ppm.gz> [--update]
+ *
+ *  --update   writes the rendered bitmap as the new reference image
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "rmparser.h"
+#include "worker_pool.h"
+
+//scale of the rendered page, keeps the reference image small
+static constexpr float test_scale = 0.25f;
+//max difference of a channel, covers rounding differences between compilers
+static constexpr int max_channel_diff = 2;
+
+static bool readGolden(const char *fname, Drawing::Bitmap &bmp) {
+	gzFile f = gzopen(fname, "rb");
+	if (!f) return false;
+	std::string data;
+	char buff[65536];
+	int rd;
+	while ((rd = gzread(f, buff, sizeof(buff))) > 0) data.append(buff, rd);
+	gzclose(f);
+	if (rd < 0) return false;
+	std::istringstream in(data);
+	std::string magic;
+	unsigned int maxval;
+	in >> magic >> bmp.width >> bmp.height >> maxval;
+	if (!in || magic != "P6" || maxval != 255) return false;
+	in.get();
+	bmp.rgb.resize(static_cast<std::size_t>(bmp.width)*bmp.height*3);
+	in.read(reinterpret_cast<char *>(bmp.rgb.data()), bmp.rgb.size());
+	return static_cast<std::size_t>(in.gcount()) == bmp.rgb.size();
+}
+
+static bool writeGolden(const char *fname, const Drawing::Bitmap &bmp) {
+	gzFile f = gzopen(fname, "wb9");
+	if (!f) return false;
+	std::string hdr = "P6\n" + std::to_string(bmp.width) + " " + std::to_string(bmp.height) + "\n255\n";
+	bool ok = gzwrite(f, hdr.data(), hdr.size()) == static_cast<int>(hdr.size())
+			&& gzwrite(f, bmp.rgb.data(), bmp.rgb.size()) == static_cast<int>(bmp.rgb.size());
+	return gzclose(f) == Z_OK && ok;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " <file.rm> <golden.ppm.gz> [--update]" << std::endl;
+		return 2;
+	}
+	bool update = argc > 3 && std::strcmp(argv[3], "--update") == 0;
+
+	std::ifstream in(argv[1], std::ios::in|std::ios::binary);
+	if (!in) {
+		std::cerr << "Can't open file: " << argv[1] << std::endl;
+		return 2;
+	}
+	Drawing drw;
+	drw.load_rm(in);
+	Drawing::ColorDef def;
+	def.prepare();
+	Drawing::PngOptions opts;
+	opts.scale = test_scale;
+
+	Drawing::Bitmap bmp, bmp_par;
+	drw.rasterize(bmp, def, opts);
+	WorkerPool pool(4);
+	drw.rasterize(bmp_par, def, opts, &pool);
+	if (bmp.width != bmp_par.width || bmp.height != bmp_par.height || bmp.rgb != bmp_par.rgb) {
+		std::cerr << "FAIL: parallel rendering differs from serial rendering" << std::endl;
+		return 1;
+	}
+
+	if (update) {
+		if (!writeGolden(argv[2], bmp)) {
+			std::cerr << "Can't write file: " << argv[2] << std::endl;
+			return 2;
+		}
+		std::cout << "written: " << argv[2] << " (" << bmp.width << "x" << bmp.height << ")" << std::endl;
+		return 0;
+	}
+
+	Drawing::Bitmap golden;
+	if (!readGolden(argv[2], golden)) {
+		std::cerr << "Can't read reference image: " << argv[2] << std::endl;
+		return 2;
+	}
+	if (golden.width != bmp.width || golden.height != bmp.height) {
+		std::cerr << "FAIL: size " << bmp.width << "x" << bmp.height
+				  << ", expected " << golden.width << "x" << golden.height << std::endl;
+		return 1;
+	}
+	std::size_t diffs = 0;
+	int maxdiff = 0;
+	for (std::size_t i = 0; i < bmp.rgb.size(); i++) {
+		int d = std::abs(static_cast<int>(bmp.rgb[i]) - static_cast<int>(golden.rgb[i]));
+		if (d > max_channel_diff) ++diffs;
+		if (d > maxdiff) maxdiff = d;
+	}
+	std::cout << bmp.width << "x" << bmp.height << ", max difference: " << maxdiff
+			  << ", differing channels: " << diffs << std::endl;
+	if (diffs) {
+		std::cerr << "FAIL: image differs from the reference image" << std::endl;
+		return 1;
+	}
+	return 0;
+}
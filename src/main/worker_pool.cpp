@@ -0,0 +1,79 @@
+/*
+ * worker_pool.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(unsigned int threads):next_index(0) {
+	for (unsigned int i = 1; i < threads; i++) {
+		this->threads.emplace_back([this]{worker();});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard _(mx);
+		stop = true;
+	}
+	cond.notify_all();
+	for (auto &t: threads) t.join();
+}
+
+void WorkerPool::parallel_for(std::size_t count, const std::function<void(std::size_t)> &fn) {
+	std::unique_lock job(job_mx, std::try_to_lock);
+	if (threads.empty() || count < 2 || !job.owns_lock()) {
+		for (std::size_t i = 0; i < count; i++) fn(i);
+		return;
+	}
+	{
+		std::lock_guard _(mx);
+		this->fn = &fn;
+		this->count = count;
+		this->finished = 0;
+		this->exception = nullptr;
+		next_index.store(0);
+		generation++;
+	}
+	cond.notify_all();
+	std::size_t done = runItems();
+	std::unique_lock lk(mx);
+	finished += done;
+	//job can be released after all workers left it
+	cond.wait(lk, [&]{return finished == this->count && active == 0;});
+	this->fn = nullptr;
+	if (exception) std::rethrow_exception(exception);
+}
+
+std::size_t WorkerPool::runItems() {
+	std::size_t done = 0;
+	for (std::size_t i = next_index.fetch_add(1); i < count; i = next_index.fetch_add(1)) {
+		try {
+			(*fn)(i);
+		} catch (...) {
+			std::lock_guard _(mx);
+			if (!exception) exception = std::current_exception();
+		}
+		done++;
+	}
+	return done;
+}
+
+void WorkerPool::worker() {
+	unsigned int seen = 0;
+	std::unique_lock lk(mx);
+	while (true) {
+		cond.wait(lk, [&]{return stop || (seen != generation && fn != nullptr);});
+		if (stop) break;
+		seen = generation;
+		active++;
+		lk.unlock();
+		std::size_t done = runItems();
+		lk.lock();
+		finished += done;
+		active--;
+		if (finished == count && active == 0) cond.notify_all();
+	}
+}
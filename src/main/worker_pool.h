@@ -0,0 +1,69 @@
+/*
+ * worker_pool.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_MAIN_WORKER_POOL_H_
+#define SRC_MAIN_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///Fixed pool of threads for data parallel tasks
+/**
+ * The pool processes one job at time. When the pool is busy, the job
+ * is processed by the calling thread
+ */
+class WorkerPool {
+public:
+	///Creates pool
+	/**
+	 * @param threads count of threads including the calling thread. Value 0 or 1
+	 * creates pool without threads, all jobs are processed by the calling thread
+	 */
+	WorkerPool(unsigned int threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	///Calls fn(i) for i in range 0..count-1, returns when all calls are done
+	/**
+	 * Calling thread participates on the job. If any call throws an exception, the
+	 * first exception is rethrown
+	 */
+	void parallel_for(std::size_t count, const std::function<void(std::size_t)> &fn);
+
+	///Count of threads including the calling thread
+	unsigned int getThreads() const {return static_cast<unsigned int>(threads.size())+1;}
+
+protected:
+	std::vector<std::thread> threads;
+	std::mutex job_mx;
+	std::mutex mx;
+	std::condition_variable cond;
+	bool stop = false;
+	unsigned int generation = 0;
+
+	//current job
+	const std::function<void(std::size_t)> *fn = nullptr;
+	std::size_t count = 0;
+	std::atomic<std::size_t> next_index;
+	std::size_t finished = 0;
+	//count of workers working on current job
+	unsigned int active = 0;
+	std::exception_ptr exception;
+
+	void worker();
+	//processes items of current job, returns count of processed items
+	std::size_t runItems();
+};
+
+#endif /* SRC_MAIN_WORKER_POOL_H_ */
@@ -0,0 +1,53 @@
+/*
+ * mapped_file.cpp
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <system_error>
+namespace pdf {
+
+static std::string_view mapFile(const std::string &fname, std::int64_t &mtime) {
+	int fd = ::open(fname.c_str(), O_RDONLY);
+	if (fd<0) throw std::system_error(errno, std::generic_category(), fname);
+	//size and time are taken from the opened file, so they describe the mapped data
+	struct stat st;
+	if (::fstat(fd, &st)) {
+		int e = errno;
+		::close(fd);
+		throw std::system_error(e, std::generic_category(), fname);
+	}
+	mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	auto len = st.st_size;
+	if (len <= 0) {
+		::close(fd);
+		return std::string_view();
+	}
+	void *p = mmap(0, len, PROT_READ,MAP_SHARED,fd,0);
+	if (p == MAP_FAILED) {
+		int e = errno;
+		::close(fd);
+		throw std::system_error(e, std::generic_category(), fname);
+	}
+	::close(fd);
+	return std::string_view(static_cast<const char *>(p), len);
+}
+
+MappedFile::MappedFile(const std::string &fname) {
+	std::string_view::operator=(mapFile(fname, mtime));
+}
+
+MappedFile::~MappedFile() {
+	if (!empty()) munmap(const_cast<char *>(data()),length());
+}
+
+}
@@ -0,0 +1,36 @@
+/*
+ * mapped_file.h
+ *
+ *  Created on: 16. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_PDF_MAPPED_FILE_H_
+#define SRC_PDF_MAPPED_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace pdf {
+
+///Maps whole file to the memory (read only). The object is the view of the mapped data
+class MappedFile: public std::string_view {
+public:
+
+	MappedFile(const std::string &fname);
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	///Returns time of modification of the mapped file (ns since epoch)
+	std::int64_t getMTime() const {return mtime;}
+
+protected:
+	std::int64_t mtime;
+};
+
+}
+
+#endif /* SRC_PDF_MAPPED_FILE_H_ */
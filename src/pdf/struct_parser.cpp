@@ -5,36 +5,11 @@
  *      Author: ondra
  */
 
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
-
 #include "struct_parser.h"
 
-#include <cerrno>
-#include <system_error>
+#include <stdexcept>
 namespace pdf {
 
-static std::string_view mapFile(const std::string &fname) {
-	int fd = ::open(fname.c_str(), O_RDONLY);
-	if (fd<0) throw std::system_error(errno, std::generic_category(), fname);
-	auto len = ::lseek(fd, 0, SEEK_END);
-	void *p = mmap(0, len, PROT_READ,MAP_SHARED,fd,0);
-	if (p == nullptr) {
-		int e = errno;
-		::close(fd);
-		throw std::system_error(e, std::generic_category(), fname);
-	}
-	::close(fd);
-	return std::string_view(static_cast<const char *>(p), len);
-}
-
-MappedFile::MappedFile(const std::string &fname):std::string_view(mapFile(fname)) {}
-
-MappedFile::~MappedFile() {
-	munmap(const_cast<char *>(data()),length());
-}
-
 void PDFFile::parseValue(SymbReader sstream, Stack &elstk) {
 	bool cont = true;
 	do {
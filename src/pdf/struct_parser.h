@@ -12,20 +12,13 @@
 #include <stack>
 
 #include <string_view>
+#include "mapped_file.h"
 #include "structs.h"
 
 
 namespace pdf {
 
 
-class MappedFile: public std::string_view {
-public:
-
-	MappedFile(const std::string &fname);
-	~MappedFile();
-
-};
-
 class PDFFile {
 public:
 